@@ -0,0 +1,71 @@
+#!/usr/bin/env bash
+# Scaling of a render on one and two sockets (NUMA nodes), without and with NUMA placement:
+#   ./bench_numa.sh <path-to-scene> [samples] [runs]
+# Each configuration renders the scene on every CPU of the nodes it uses, `runs` times, and reports the best time and
+# the speedup over the unpinned run on one socket. Needs a Release build in ./build; uses numactl when installed and
+# taskset otherwise.
+set -e
+
+scene="$1"
+samples="${2:-64}"
+runs="${3:-3}"
+engine="$(dirname "$0")/build/engine"
+if [ -z "$scene" ] || [ ! -x "$engine" ]; then
+    echo "Usage: ./bench_numa.sh <path-to-scene> [samples] [runs] (after ./build.sh)"
+    exit 1
+fi
+
+nodes=()
+for node in /sys/devices/system/node/node[0-9]*; do
+    [ -s "$node/cpulist" ] && [ -n "$(cat "$node/cpulist")" ] && nodes+=("$(cat "$node/cpulist")")
+done
+if [ "${#nodes[@]}" -eq 0 ]; then
+    nodes=("0-$(($(nproc) - 1))")
+fi
+
+# "0-3,8" -> 5
+count_cpus() {
+    echo "$1" | tr ',' '\n' | awk -F- '{ n += ($2 == "" ? 1 : $2 - $1 + 1) } END { print n }'
+}
+
+# best_time <cpus> <node list> <options...>
+best_time() {
+    local cpus="$1" node_list="$2"
+    shift 2
+    local threads best="" elapsed
+    threads=$(count_cpus "$cpus")
+    for _ in $(seq "$runs"); do
+        local start end
+        start=$(date +%s.%N)
+        if command -v numactl > /dev/null; then
+            numactl --cpunodebind="$node_list" --membind="$node_list" \
+                "$engine" "$scene" /dev/null -samples "$samples" -seed 1 -threads "$threads" "$@" > /dev/null
+        else
+            taskset -c "$cpus" "$engine" "$scene" /dev/null -samples "$samples" -seed 1 -threads "$threads" "$@" > /dev/null
+        fi
+        end=$(date +%s.%N)
+        elapsed=$(awk -v a="$start" -v b="$end" 'BEGIN { printf "%.3f", b - a }')
+        if [ -z "$best" ] || awk -v a="$elapsed" -v b="$best" 'BEGIN { exit !(a < b) }'; then
+            best=$elapsed
+        fi
+    done
+    echo "$best"
+}
+
+printf "%-8s %-8s %-28s %10s %8s\n" sockets threads options seconds speedup
+baseline=""
+for sockets in 1 2; do
+    if [ "$sockets" -gt "${#nodes[@]}" ]; then
+        echo "(only ${#nodes[@]} NUMA node(s) here: no $sockets-socket runs)"
+        break
+    fi
+    cpus=$(IFS=,; echo "${nodes[*]:0:$sockets}")
+    node_list=$(seq -s, 0 $((sockets - 1)))
+    for options in "" "-affinity" "-affinity -numa-replicas"; do
+        # shellcheck disable=SC2086
+        seconds=$(best_time "$cpus" "$node_list" $options)
+        baseline=${baseline:-$seconds}
+        speedup=$(awk -v a="$baseline" -v b="$seconds" 'BEGIN { printf "%.2f", a / b }')
+        printf "%-8s %-8s %-28s %10s %8s\n" "$sockets" "$(count_cpus "$cpus")" "${options:-(none)}" "$seconds" "$speedup"
+    done
+done
@@ -0,0 +1,111 @@
+#include "alias.hpp"
+#include "light_tree.hpp"
+#include "ray.hpp"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <stdexcept>
+
+namespace engine::rand {
+
+void AliasTable::build(const std::vector<float>& weights) {
+    const std::size_t n = weights.size();
+    keep.assign(n, 1.f);
+    alias.resize(n);
+    probability.resize(n);
+    double total = 0.0;
+    for (float weight : weights) {
+        total += weight;
+    }
+    if (n == 0) {
+        return;
+    }
+
+    // Scaled weights: buckets below 1 are topped up by the alias of a bucket above 1.
+    std::vector<double> scaled(n);
+    std::vector<std::uint32_t> small, large;
+    for (std::uint32_t i = 0; i < n; ++i) {
+        probability[i] = total > 0.0 ? static_cast<float>(weights[i] / total) : 1.f / n;
+        scaled[i] = total > 0.0 ? weights[i] * n / total : 1.0;
+        alias[i] = i;
+        (scaled[i] < 1.0 ? small : large).push_back(i);
+    }
+    while (!small.empty() && !large.empty()) {
+        std::uint32_t s = small.back();
+        small.pop_back();
+        std::uint32_t l = large.back();
+        keep[s] = static_cast<float>(scaled[s]);
+        alias[s] = l;
+        scaled[l] -= 1.0 - scaled[s];
+        if (scaled[l] < 1.0) {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+    // Whatever is left is 1 up to rounding.
+    for (std::uint32_t i : small) {
+        keep[i] = 1.f;
+    }
+    for (std::uint32_t i : large) {
+        keep[i] = 1.f;
+    }
+}
+
+std::uint32_t AliasTable::sample(float u1, float u2) const {
+    std::uint32_t bucket = std::min(static_cast<std::uint32_t>(u1 * keep.size()),
+                                    static_cast<std::uint32_t>(keep.size() - 1));
+    return u2 < keep[bucket] ? bucket : alias[bucket];
+}
+
+PowerLights::PowerLights(const std::vector<Shape*>& emitters) {
+    if (emitters.empty()) {
+        throw std::runtime_error("Power light sampling needs at least one emitter");
+    }
+    std::vector<float> weights;
+    for (Shape* emitter : emitters) {
+        weights.push_back(emitter_power(emitter));
+        lights.emplace_back(std::make_unique<Light>(emitter));
+    }
+    table.build(weights);
+    bvh.build(emitters);
+}
+
+glm::vec3 PowerLights::sample(glm::vec3 x, glm::vec3 n, float time) {
+    float u1 = Rng::get_instance().uniform_01();
+    float u2 = Rng::get_instance().uniform_01();
+    return lights[table.sample(u1, u2)]->sample(x, n, time);
+}
+
+float PowerLights::pdf(glm::vec3 x, glm::vec3 n, glm::vec3 d, float time) {
+    ray::Ray r;
+    r.start = x;
+    r.direction = d;
+    glm::vec3 inv_direction = 1.f / d;
+    const float t_max = std::numeric_limits<float>::infinity();
+
+    std::array<std::uint32_t, Bvh::max_depth + 1> stack;
+    std::size_t stack_size = 0;
+    stack[stack_size++] = 0;
+    float result = 0.f;
+    while (stack_size > 0) {
+        std::uint32_t node_index = stack[--stack_size];
+        const BvhNode& node = bvh.nodes[node_index];
+        if (!ray::intersect_aabb(r, inv_direction, node.bounds, t_max)) {
+            continue;
+        }
+        if (node.count > 0) {
+            for (std::uint32_t i = 0; i < node.count; ++i) {
+                std::uint32_t light = bvh.indices[node.offset + i];
+                result += table.probability[light] * lights[light]->pdf(x, n, d, time);
+            }
+        }
+        else {
+            stack[stack_size++] = node.offset;
+            stack[stack_size++] = node_index + 1;
+        }
+    }
+    return result;
+}
+
+} // namespace engine::rand
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "bvh.hpp"
+#include "distributions.hpp"
+#include "primitive.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace engine::rand {
+
+// Walker's alias method: O(1) sampling of an index proportional to non-negative weights.
+struct AliasTable {
+    // Probability of keeping the bucket index instead of taking its alias.
+    std::vector<float> keep;
+    std::vector<std::uint32_t> alias;
+    // Normalized weights, the probability of sampling each index.
+    std::vector<float> probability;
+
+    void build(const std::vector<float>& weights);
+    std::uint32_t sample(float u1, float u2) const;
+};
+
+// Picks an emitter with probability proportional to its power, then samples it. pdf only evaluates the emitters
+// whose bounds the direction crosses (found through a BVH over the emitters) and looks their selection probability
+// up in the table.
+class PowerLights : public IDistribution {
+public:
+    PowerLights(const std::vector<Shape*>& emitters);
+
+    glm::vec3 sample(glm::vec3 x, glm::vec3 n, float time) final;
+    float pdf(glm::vec3 x, glm::vec3 n, glm::vec3 d, float time) final;
+
+private:
+    AliasTable table;
+    Bvh bvh;
+    std::vector<std::unique_ptr<Light>> lights;
+};
+
+} // namespace engine::rand
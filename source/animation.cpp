@@ -0,0 +1,87 @@
+#include "animation.hpp"
+#include "glm/geometric.hpp"
+#include "scene.hpp"
+
+#include <cmath>
+
+namespace engine {
+
+glm::vec3 interpolate(const glm::vec3& a, const glm::vec3& b, float f) {
+    return a + (b - a) * f;
+}
+
+glm::quat interpolate(const glm::quat& a, const glm::quat& b, float f) {
+    return glm::normalize(glm::slerp(a, glm::dot(a, b) < 0.f ? -b : b, f));
+}
+
+bool Animation::empty() const {
+    return camera_position.empty() && camera_forward.empty() && camera_up.empty() && primitives.empty();
+}
+
+PrimitiveAnimation& Animation::primitive(std::uint32_t index) {
+    if (primitives.empty() || primitives.back().primitive != index) {
+        primitives.push_back(PrimitiveAnimation{index, {}, {}});
+    }
+    return primitives.back();
+}
+
+std::uint32_t Animation::frame_count() const {
+    if (frames > 0) {
+        return frames;
+    }
+    float last = 0.f;
+    auto extend = [&last](const auto& track) {
+        if (!track.empty()) {
+            last = std::max(last, track.keys.back().first);
+        }
+    };
+    extend(camera_position);
+    extend(camera_forward);
+    extend(camera_up);
+    for (const PrimitiveAnimation& animation : primitives) {
+        extend(animation.position);
+        extend(animation.rotation);
+    }
+    return static_cast<std::uint32_t>(std::floor(last)) + 1;
+}
+
+Animation::Changes Animation::apply(Scene& scene, float time) const {
+    Camera& camera = scene.camera;
+    if (!camera_position.empty()) {
+        camera.camera_position = camera_position.at(time);
+    }
+    if (!camera_forward.empty() || !camera_up.empty()) {
+        glm::vec3 forward = camera_forward.empty() ? camera.camera_forward : glm::normalize(camera_forward.at(time));
+        glm::vec3 up = camera_up.empty() ? camera.camera_up : glm::normalize(camera_up.at(time));
+        camera.camera_forward = forward;
+        camera.camera_right = glm::normalize(glm::cross(forward, up));
+        camera.camera_up = glm::cross(camera.camera_right, forward);
+    }
+
+    Changes changes;
+    for (const PrimitiveAnimation& animation : primitives) {
+        Shape* primitive = scene.primitives[animation.primitive];
+        if (!animation.position.empty()) {
+            primitive->position = animation.position.at(time);
+        }
+        if (!animation.rotation.empty()) {
+            primitive->rotation = animation.rotation.at(time);
+        }
+        if (shutter > 0.f) {
+            Motion motion;
+            if (!animation.position.empty()) {
+                motion.translation = animation.position.at(time + shutter) - primitive->position;
+            }
+            if (!animation.rotation.empty()) {
+                motion.rotation = glm::normalize(animation.rotation.at(time + shutter) *
+                                                 glm::inverse(primitive->rotation));
+            }
+            primitive->motion = motion;
+        }
+        changes.primitives = true;
+        changes.emitters |= primitive->emission != glm::vec3{0.f, 0.f, 0.f};
+    }
+    return changes;
+}
+
+} // namespace engine
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "glm/gtc/quaternion.hpp"
+#include "glm/vec3.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace engine {
+
+struct Scene;
+
+glm::vec3 interpolate(const glm::vec3& a, const glm::vec3& b, float f);
+// Shortest-arc slerp.
+glm::quat interpolate(const glm::quat& a, const glm::quat& b, float f);
+
+// Keyframed value: interpolated between the keys around a time, held constant before the first and after the last.
+template <typename T>
+struct Track {
+    // Sorted by time (in frames).
+    std::vector<std::pair<float, T>> keys;
+
+    bool empty() const {
+        return keys.empty();
+    }
+
+    void add(float time, const T& value) {
+        auto it = std::lower_bound(keys.begin(), keys.end(), time,
+                                   [](const std::pair<float, T>& key, float t) { return key.first < t; });
+        if (it != keys.end() && it->first == time) {
+            it->second = value;
+        }
+        else {
+            keys.insert(it, {time, value});
+        }
+    }
+
+    T at(float time) const {
+        if (time <= keys.front().first) {
+            return keys.front().second;
+        }
+        if (time >= keys.back().first) {
+            return keys.back().second;
+        }
+        auto next = std::upper_bound(keys.begin(), keys.end(), time,
+                                     [](float t, const std::pair<float, T>& key) { return t < key.first; });
+        auto prev = next - 1;
+        return interpolate(prev->second, next->second, (time - prev->first) / (next->first - prev->first));
+    }
+};
+
+struct PrimitiveAnimation {
+    std::uint32_t primitive;
+    Track<glm::vec3> position;
+    Track<glm::quat> rotation;
+};
+
+// Keyframes of a scene: the camera and per-primitive transforms over `frames` frames.
+struct Animation {
+    struct Changes {
+        bool primitives = false;
+        bool emitters = false;
+    };
+
+    std::uint32_t frames = 0;
+    // Fraction of a frame the shutter stays open. Animated primitives blur over [time, time + shutter].
+    float shutter = 0.f;
+    Track<glm::vec3> camera_position;
+    Track<glm::vec3> camera_forward;
+    Track<glm::vec3> camera_up;
+    std::vector<PrimitiveAnimation> primitives;
+
+    bool empty() const;
+    // Keys of the primitive, created on first use.
+    PrimitiveAnimation& primitive(std::uint32_t index);
+    // Frame count: `frames` when set, otherwise up to the last key.
+    std::uint32_t frame_count() const;
+    // Moves the camera and the animated primitives to their transforms at `time`, with their motion over the shutter
+    // interval. The acceleration structures are left alone; the result tells whether they need
+    // Scene::update_transforms.
+    Changes apply(Scene& scene, float time) const;
+};
+
+} // namespace engine
@@ -0,0 +1,109 @@
+#include "batch.hpp"
+#include "io.hpp"
+#include "trace.hpp"
+
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+namespace engine::batch {
+
+std::vector<Job> read_manifest(const std::string& path) {
+    std::ifstream in(path);
+    if (!in.is_open()) {
+        throw std::runtime_error("Bad path to batch manifest.");
+    }
+    std::vector<Job> jobs;
+    std::string line;
+    for (std::size_t line_number = 1; std::getline(in, line); ++line_number) {
+        std::stringstream ss(line);
+        Job job;
+        if (!(ss >> job.scene_path) || job.scene_path[0] == '#') {
+            continue;
+        }
+        if (!(ss >> job.image_path)) {
+            throw std::runtime_error("Manifest line " + std::to_string(line_number) + " has no output path.");
+        }
+        jobs.push_back(job);
+    }
+    return jobs;
+}
+
+std::size_t render(const std::vector<Job>& jobs,
+                   LIGHT_SAMPLING light_sampling,
+                   const RenderOptions& options,
+                   const std::string& bvh_cache) {
+    if (options.pool == nullptr) {
+        throw std::runtime_error("Batch rendering needs a thread pool.");
+    }
+    auto load = [light_sampling, &bvh_cache](const Job& job) {
+        trace::Span span("load_scene " + job.scene_path);
+        return std::make_unique<Scene>(io::load_scene(job.scene_path, light_sampling, bvh_cache));
+    };
+    auto write = [](const Job& job, std::uint32_t width, std::uint32_t height, Image image) {
+        trace::Span span("write_image " + job.image_path);
+        io::write_image(job.image_path, width, height, image);
+    };
+
+    std::size_t failed = 0;
+    auto report = [&failed](const Job& job, const std::exception& e) {
+        std::cerr << job.scene_path << ": " << e.what() << std::endl;
+        ++failed;
+    };
+
+    std::future<std::unique_ptr<Scene>> next;
+    if (!jobs.empty()) {
+        next = std::async(std::launch::async, load, jobs[0]);
+    }
+    std::future<void> writing;
+    const Job* written = nullptr;
+    for (std::size_t i = 0; i < jobs.size(); ++i) {
+        std::unique_ptr<Scene> scene;
+        try {
+            scene = next.get();
+        }
+        catch (const std::exception& e) {
+            report(jobs[i], e);
+        }
+        if (i + 1 < jobs.size()) {
+            next = std::async(std::launch::async, load, jobs[i + 1]);
+        }
+        if (scene == nullptr) {
+            continue;
+        }
+
+        Image image;
+        try {
+            image = generate_image(*scene, options);
+        }
+        catch (const std::exception& e) {
+            report(jobs[i], e);
+            continue;
+        }
+
+        if (writing.valid()) {
+            try {
+                writing.get();
+            }
+            catch (const std::exception& e) {
+                report(*written, e);
+            }
+        }
+        written = &jobs[i];
+        writing = std::async(std::launch::async, write, jobs[i], scene->width, scene->height, std::move(image));
+    }
+    if (writing.valid()) {
+        try {
+            writing.get();
+        }
+        catch (const std::exception& e) {
+            report(*written, e);
+        }
+    }
+    return failed;
+}
+
+} // namespace engine::batch
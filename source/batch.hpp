@@ -0,0 +1,28 @@
+#pragma once
+
+#include "image.hpp"
+#include "scene.hpp"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace engine::batch {
+
+struct Job {
+    std::string scene_path;
+    std::string image_path;
+};
+
+// One job per line: "<path-to-scene> <path-to-image>". Empty lines and lines starting with '#' are skipped.
+std::vector<Job> read_manifest(const std::string& path);
+
+// Renders the jobs in order on options.pool. Loading of the next scene and writing of the previous image run on
+// their own threads while the current scene renders. A job that fails is reported on stderr and skipped; returns the
+// number of failed jobs. Scenes share the BVH cache directory `bvh_cache` if one is given.
+std::size_t render(const std::vector<Job>& jobs,
+                   LIGHT_SAMPLING light_sampling,
+                   const RenderOptions& options,
+                   const std::string& bvh_cache = "");
+
+} // namespace engine::batch
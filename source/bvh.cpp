@@ -0,0 +1,383 @@
+#include "bvh.hpp"
+#include "instance.hpp"
+#include "mesh.hpp"
+#include "thread_pool.hpp"
+#include "glm/common.hpp"
+#include "glm/geometric.hpp"
+#include "glm/gtc/quaternion.hpp"
+#include "glm/mat3x3.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
+#include <limits>
+
+namespace engine {
+
+Aabb::Aabb()
+    : min(std::numeric_limits<float>::infinity()),
+      max(-std::numeric_limits<float>::infinity()) {}
+
+void Aabb::extend(const glm::vec3& point) {
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+}
+
+void Aabb::extend(const Aabb& other) {
+    min = glm::min(min, other.min);
+    max = glm::max(max, other.max);
+}
+
+glm::vec3 Aabb::center() const {
+    return (min + max) * 0.5f;
+}
+
+float Aabb::surface_area() const {
+    glm::vec3 size = max - min;
+    if (size.x < 0 || size.y < 0 || size.z < 0) {
+        return 0.f;
+    }
+    return 2.f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+namespace {
+
+// Object-space bounds of the shapes that are defined by shared geometry.
+const Aabb& local_bounds(const Shape* shape) {
+    if (shape->type == PRIMITIVE_TYPE::Mesh) {
+        return dynamic_cast<const Mesh*>(shape)->data->bounds;
+    }
+    return dynamic_cast<const Instance*>(shape)->object->bounds;
+}
+
+Aabb transformed_bounds(const Shape* shape, const glm::vec3& position, const glm::quat& orientation) {
+    glm::mat3 rotation = glm::mat3_cast(orientation);
+    glm::vec3 center = position;
+    glm::vec3 extent{};
+    switch (shape->type) {
+    case PRIMITIVE_TYPE::Ellipsoid: {
+        const glm::vec3& radius = dynamic_cast<const Ellipsoid*>(shape)->radius;
+        for (int i = 0; i < 3; ++i) {
+            glm::vec3 row{rotation[0][i] * radius.x, rotation[1][i] * radius.y, rotation[2][i] * radius.z};
+            extent[i] = std::sqrt(glm::dot(row, row));
+        }
+        break;
+    }
+    case PRIMITIVE_TYPE::Box: {
+        const glm::vec3& size = dynamic_cast<const Box*>(shape)->size;
+        for (int i = 0; i < 3; ++i) {
+            extent[i] = std::abs(rotation[0][i]) * size.x + std::abs(rotation[1][i]) * size.y +
+                        std::abs(rotation[2][i]) * size.z;
+        }
+        break;
+    }
+    case PRIMITIVE_TYPE::Mesh:
+    case PRIMITIVE_TYPE::Instance: {
+        // The object-space box of a mesh or an object need not be centered on its origin.
+        const Aabb& local = local_bounds(shape);
+        glm::vec3 half_size = 0.5f * (local.max - local.min);
+        for (int i = 0; i < 3; ++i) {
+            extent[i] = std::abs(rotation[0][i]) * half_size.x + std::abs(rotation[1][i]) * half_size.y +
+                        std::abs(rotation[2][i]) * half_size.z;
+        }
+        center += rotation * local.center();
+        break;
+    }
+    default:
+        return Aabb{};
+    }
+    Aabb result;
+    result.min = center - extent;
+    result.max = center + extent;
+    return result;
+}
+
+// Distance from the shape's origin to its farthest point.
+float bounding_radius(const Shape* shape) {
+    switch (shape->type) {
+    case PRIMITIVE_TYPE::Ellipsoid:
+        return glm::length(dynamic_cast<const Ellipsoid*>(shape)->radius);
+    case PRIMITIVE_TYPE::Box:
+        return glm::length(dynamic_cast<const Box*>(shape)->size);
+    case PRIMITIVE_TYPE::Mesh:
+    case PRIMITIVE_TYPE::Instance: {
+        const Aabb& local = local_bounds(shape);
+        return glm::length(glm::max(glm::abs(local.min), glm::abs(local.max)));
+    }
+    default:
+        return std::numeric_limits<float>::infinity();
+    }
+}
+
+} // namespace
+
+Aabb shape_bounds(const Shape* shape) {
+    Aabb result = transformed_bounds(shape, shape->position, shape->rotation);
+    if (!shape->motion.has_value() || shape->type == PRIMITIVE_TYPE::Plane) {
+        return result;
+    }
+    glm::vec3 end = shape->position_at(1.f);
+    if (shape->motion->rotation == glm::quat{1.f, 0.f, 0.f, 0.f}) {
+        // A shape swept along a line stays within the bounds of its two ends.
+        result.extend(transformed_bounds(shape, end, shape->rotation));
+        return result;
+    }
+    // Turning: bound every orientation by the sphere around the shape along its path.
+    float radius = bounding_radius(shape);
+    result.extend(glm::min(shape->position, end) - radius);
+    result.extend(glm::max(shape->position, end) + radius);
+    return result;
+}
+
+namespace {
+
+constexpr std::size_t bins_count = 12;
+constexpr std::uint32_t max_leaf_size = 4;
+constexpr std::uint32_t max_sah_leaf_size = 16;
+constexpr float traversal_cost = 1.f;
+
+struct Builder {
+    Bvh& bvh;
+    std::vector<Aabb> bounds;
+    std::vector<glm::vec3> centers;
+
+    std::uint32_t build(std::uint32_t begin, std::uint32_t end, std::uint32_t depth);
+};
+
+std::uint32_t Builder::build(std::uint32_t begin, std::uint32_t end, std::uint32_t depth) {
+    std::uint32_t node_index = static_cast<std::uint32_t>(bvh.nodes.size());
+    bvh.nodes.emplace_back();
+
+    Aabb node_bounds;
+    Aabb center_bounds;
+    for (std::uint32_t i = begin; i < end; ++i) {
+        node_bounds.extend(bounds[bvh.indices[i]]);
+        center_bounds.extend(centers[bvh.indices[i]]);
+    }
+    bvh.nodes[node_index].bounds = node_bounds;
+
+    const std::uint32_t count = end - begin;
+    auto make_leaf = [&] {
+        bvh.nodes[node_index].offset = begin;
+        bvh.nodes[node_index].count = count;
+        return node_index;
+    };
+    if (count <= max_leaf_size || depth + 1 == Bvh::max_depth) {
+        return make_leaf();
+    }
+
+    int best_axis = -1;
+    std::size_t best_split = 0;
+    float best_cost = std::numeric_limits<float>::infinity();
+    glm::vec3 extent = center_bounds.max - center_bounds.min;
+    for (int axis = 0; axis < 3; ++axis) {
+        if (extent[axis] <= 0.f) {
+            continue;
+        }
+        std::array<Aabb, bins_count> bin_bounds{};
+        std::array<std::uint32_t, bins_count> bin_counts{};
+        for (std::uint32_t i = begin; i < end; ++i) {
+            std::uint32_t primitive = bvh.indices[i];
+            auto bin = static_cast<std::size_t>((centers[primitive][axis] - center_bounds.min[axis]) / extent[axis] *
+                                                bins_count);
+            bin = std::min(bin, bins_count - 1);
+            bin_bounds[bin].extend(bounds[primitive]);
+            ++bin_counts[bin];
+        }
+
+        std::array<float, bins_count> right_areas{};
+        std::array<std::uint32_t, bins_count> right_counts{};
+        Aabb right;
+        std::uint32_t right_count = 0;
+        for (std::size_t bin = bins_count - 1; bin > 0; --bin) {
+            right.extend(bin_bounds[bin]);
+            right_count += bin_counts[bin];
+            right_areas[bin] = right.surface_area();
+            right_counts[bin] = right_count;
+        }
+
+        Aabb left;
+        std::uint32_t left_count = 0;
+        for (std::size_t split = 1; split < bins_count; ++split) {
+            left.extend(bin_bounds[split - 1]);
+            left_count += bin_counts[split - 1];
+            float cost = left.surface_area() * left_count + right_areas[split] * right_counts[split];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = split;
+            }
+        }
+    }
+
+    float leaf_cost = static_cast<float>(count);
+    best_cost = traversal_cost + best_cost / std::max(node_bounds.surface_area(), std::numeric_limits<float>::min());
+
+    std::uint32_t* first = bvh.indices.data() + begin;
+    std::uint32_t* last = bvh.indices.data() + end;
+    std::uint32_t* middle = nullptr;
+    if (best_axis < 0 || (best_cost >= leaf_cost && count <= max_sah_leaf_size)) {
+        return make_leaf();
+    }
+    if (best_cost < leaf_cost) {
+        middle = std::partition(first, last, [&](std::uint32_t primitive) {
+            auto bin = static_cast<std::size_t>((centers[primitive][best_axis] - center_bounds.min[best_axis]) /
+                                                extent[best_axis] * bins_count);
+            return std::min(bin, bins_count - 1) < best_split;
+        });
+    }
+    if (middle == nullptr || middle == first || middle == last) {
+        // SAH sees no gain but the leaf would be large: fall back to a median split on the widest axis.
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        middle = first + count / 2;
+        std::nth_element(first, middle, last, [&](std::uint32_t a, std::uint32_t b) {
+            return centers[a][axis] < centers[b][axis];
+        });
+    }
+
+    std::uint32_t mid = static_cast<std::uint32_t>(middle - bvh.indices.data());
+    build(begin, mid, depth + 1);
+    std::uint32_t right_child = build(mid, end, depth + 1);
+    bvh.nodes[node_index].offset = right_child;
+    bvh.nodes[node_index].count = 0;
+    return node_index;
+}
+
+void refit_node(Bvh& bvh, const std::vector<Shape*>& primitives, std::uint32_t index) {
+    BvhNode& node = bvh.nodes[index];
+    Aabb bounds;
+    if (node.count > 0) {
+        for (std::uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+            bounds.extend(shape_bounds(primitives[bvh.indices[i]]));
+        }
+    }
+    else {
+        bounds = bvh.nodes[index + 1].bounds;
+        bounds.extend(bvh.nodes[node.offset].bounds);
+    }
+    node.bounds = bounds;
+}
+
+// Nodes are stored depth first, so a subtree is the contiguous range from its root to the last node on its rightmost
+// path, and every child comes after its parent.
+std::uint32_t subtree_end(const Bvh& bvh, std::uint32_t root) {
+    while (bvh.nodes[root].count == 0) {
+        root = bvh.nodes[root].offset;
+    }
+    return root + 1;
+}
+
+} // namespace
+
+void Bvh::build(const std::vector<Shape*>& primitives) {
+    nodes.clear();
+    indices.clear();
+    unbounded.clear();
+
+    Builder builder{*this, std::vector<Aabb>(primitives.size()), std::vector<glm::vec3>(primitives.size())};
+    for (std::uint32_t i = 0; i < primitives.size(); ++i) {
+        if (primitives[i]->type == PRIMITIVE_TYPE::Plane) {
+            unbounded.push_back(i);
+            continue;
+        }
+        builder.bounds[i] = shape_bounds(primitives[i]);
+        builder.centers[i] = builder.bounds[i].center();
+        indices.push_back(i);
+    }
+    if (indices.empty()) {
+        return;
+    }
+    nodes.reserve(2 * indices.size());
+    builder.build(0, static_cast<std::uint32_t>(indices.size()), 0);
+    built_cost = sah_cost();
+}
+
+void Bvh::build(const std::vector<Aabb>& bounds) {
+    nodes.clear();
+    indices.clear();
+    unbounded.clear();
+
+    Builder builder{*this, bounds, std::vector<glm::vec3>(bounds.size())};
+    for (std::uint32_t i = 0; i < bounds.size(); ++i) {
+        builder.centers[i] = bounds[i].center();
+        indices.push_back(i);
+    }
+    if (indices.empty()) {
+        return;
+    }
+    nodes.reserve(2 * indices.size());
+    builder.build(0, static_cast<std::uint32_t>(indices.size()), 0);
+    built_cost = sah_cost();
+}
+
+void Bvh::refit(const std::vector<Shape*>& primitives, ThreadPool* pool) {
+    if (nodes.empty()) {
+        return;
+    }
+    // Split the top of the tree until there are enough subtrees to keep the pool busy; the nodes above them are
+    // refit afterwards, children first.
+    std::vector<std::uint32_t> roots{0};
+    std::vector<std::uint32_t> top;
+    const std::size_t target = pool != nullptr ? 4 * pool->size() : 1;
+    while (roots.size() < target) {
+        std::vector<std::uint32_t> next;
+        for (std::uint32_t root : roots) {
+            if (nodes[root].count == 0) {
+                top.push_back(root);
+                next.push_back(root + 1);
+                next.push_back(nodes[root].offset);
+            }
+            else {
+                next.push_back(root);
+            }
+        }
+        if (next.size() == roots.size()) {
+            break;
+        }
+        roots = std::move(next);
+    }
+
+    auto refit_subtree = [&](std::size_t i) {
+        std::uint32_t root = roots[i];
+        for (std::uint32_t node = subtree_end(*this, root); node-- > root;) {
+            refit_node(*this, primitives, node);
+        }
+    };
+    if (pool != nullptr && roots.size() > 1) {
+        pool->parallel_for(roots.size(), refit_subtree);
+    }
+    else {
+        for (std::size_t i = 0; i < roots.size(); ++i) {
+            refit_subtree(i);
+        }
+    }
+    std::sort(top.begin(), top.end(), std::greater<>());
+    for (std::uint32_t node : top) {
+        refit_node(*this, primitives, node);
+    }
+}
+
+bool Bvh::update(const std::vector<Shape*>& primitives, ThreadPool* pool, float rebuild_ratio) {
+    refit(primitives, pool);
+    if (sah_cost() <= rebuild_ratio * built_cost) {
+        return false;
+    }
+    build(primitives);
+    return true;
+}
+
+float Bvh::sah_cost() const {
+    if (nodes.empty()) {
+        return 0.f;
+    }
+    float root_area = std::max(nodes[0].bounds.surface_area(), std::numeric_limits<float>::min());
+    float cost = 0.f;
+    for (const BvhNode& node : nodes) {
+        float weight = node.count > 0 ? static_cast<float>(node.count) : traversal_cost;
+        cost += weight * node.bounds.surface_area();
+    }
+    return cost / root_area;
+}
+
+} // namespace engine
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "glm/vec3.hpp"
+#include "primitive.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace engine {
+
+class ThreadPool;
+
+struct Aabb {
+    Aabb();
+
+    glm::vec3 min;
+    glm::vec3 max;
+
+    void extend(const glm::vec3& point);
+    void extend(const Aabb& other);
+    glm::vec3 center() const;
+    float surface_area() const;
+};
+
+Aabb shape_bounds(const Shape* shape);
+
+struct BvhNode {
+    Aabb bounds;
+    // Leaf: first entry of Bvh::indices. Interior: index of the right child, the left child follows the node.
+    std::uint32_t offset;
+    // Number of primitives in a leaf, 0 for interior nodes.
+    std::uint32_t count;
+};
+
+// Bounding volume hierarchy over the bounded primitives of a scene, built with binned SAH.
+// Planes have no finite bounds and are kept aside in `unbounded`.
+struct Bvh {
+    static constexpr std::uint32_t max_depth = 64;
+
+    std::vector<BvhNode> nodes;
+    std::vector<std::uint32_t> indices;
+    std::vector<std::uint32_t> unbounded;
+    // SAH cost right after the last full build, the reference the refit quality check compares against.
+    float built_cost = 0.f;
+
+    void build(const std::vector<Shape*>& primitives);
+    // Tree over arbitrary boxes, e.g. the triangles of a mesh; indices refer to positions in `bounds`.
+    void build(const std::vector<Aabb>& bounds);
+    // Recomputes node bounds bottom-up from the current primitive transforms and keeps the tree topology, so the set
+    // of primitives must be the one the tree was built from. Independent subtrees are refit in parallel on the pool.
+    void refit(const std::vector<Shape*>& primitives, ThreadPool* pool = nullptr);
+    // Refits, then rebuilds from scratch when the SAH cost has grown past `rebuild_ratio` times the cost of the last
+    // build. Returns true when the tree was rebuilt.
+    bool update(const std::vector<Shape*>& primitives, ThreadPool* pool = nullptr, float rebuild_ratio = 1.5f);
+    // Expected cost of tracing a ray through the tree, in primitive tests, from the node surface areas.
+    float sah_cost() const;
+};
+
+} // namespace engine
@@ -0,0 +1,235 @@
+#include "bvh_cache.hpp"
+#include "trace.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace engine::bvh_cache {
+
+namespace {
+
+constexpr char magic[4] = {'R', 'T', 'B', 'V'};
+
+struct Header {
+    char magic[4];
+    std::uint32_t version;
+    std::uint64_t key;
+    std::uint32_t primitive_count;
+    std::uint32_t node_count;
+    std::uint32_t index_count;
+    std::uint32_t unbounded_count;
+    float built_cost;
+    std::uint32_t node_size;
+};
+
+static_assert(std::is_trivially_copyable_v<BvhNode>, "BVH nodes are copied straight out of the cache file");
+
+// Owns a read-only mapping of a whole file.
+class Mapping {
+public:
+    explicit Mapping(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat info {};
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* address = mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address != MAP_FAILED) {
+                data = static_cast<const char*>(address);
+                size = static_cast<std::size_t>(info.st_size);
+            }
+        }
+        close(fd);
+    }
+    ~Mapping() {
+        if (data != nullptr) {
+            munmap(const_cast<char*>(data), size);
+        }
+    }
+    Mapping(const Mapping&) = delete;
+    Mapping& operator=(const Mapping&) = delete;
+
+    const char* data = nullptr;
+    std::size_t size = 0;
+};
+
+void mix(std::uint64_t& hash, std::uint32_t word) {
+    hash = (hash ^ word) * 0x100000001B3ull;
+}
+
+void mix(std::uint64_t& hash, const glm::vec3& v) {
+    for (int axis = 0; axis < 3; ++axis) {
+        std::uint32_t bits;
+        std::memcpy(&bits, &v[axis], sizeof(bits));
+        mix(hash, bits);
+    }
+}
+
+// Checks everything traversal relies on, so a corrupt file is rejected instead of crashing the render.
+bool consistent(const BvhNode* nodes, const Header& header, const std::uint32_t* indices,
+                const std::uint32_t* unbounded) {
+    if (header.index_count + header.unbounded_count != header.primitive_count ||
+        (header.node_count == 0) != (header.index_count == 0)) {
+        return false;
+    }
+    for (std::uint32_t i = 0; i < header.index_count; ++i) {
+        if (indices[i] >= header.primitive_count) {
+            return false;
+        }
+    }
+    for (std::uint32_t i = 0; i < header.unbounded_count; ++i) {
+        if (unbounded[i] >= header.primitive_count) {
+            return false;
+        }
+    }
+    for (std::uint32_t i = 0; i < header.node_count; ++i) {
+        const BvhNode& node = nodes[i];
+        if (node.count > 0 ? node.offset > header.index_count || node.count > header.index_count - node.offset
+                           : node.offset <= i + 1 || node.offset >= header.node_count) {
+            return false;
+        }
+    }
+    if (header.node_count == 0) {
+        return true;
+    }
+    // Traversal stacks hold Bvh::max_depth levels and assume a tree: every node must be reached exactly once from
+    // the root, no deeper than the builder goes.
+    std::vector<bool> reached(header.node_count);
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> stack{{0, 0}};
+    std::uint32_t reached_count = 0;
+    while (!stack.empty()) {
+        auto [index, depth] = stack.back();
+        stack.pop_back();
+        if (reached[index] || depth >= Bvh::max_depth) {
+            return false;
+        }
+        reached[index] = true;
+        ++reached_count;
+        if (nodes[index].count == 0) {
+            stack.emplace_back(nodes[index].offset, depth + 1);
+            stack.emplace_back(index + 1, depth + 1);
+        }
+    }
+    return reached_count == header.node_count;
+}
+
+} // namespace
+
+std::uint64_t key(const std::vector<Shape*>& primitives) {
+    std::uint64_t hash = 0xCBF29CE484222325ull;
+    mix(hash, version);
+    mix(hash, static_cast<std::uint32_t>(primitives.size()));
+    for (const Shape* primitive : primitives) {
+        if (primitive->type == PRIMITIVE_TYPE::Plane) {
+            mix(hash, 0u);
+            continue;
+        }
+        Aabb bounds = shape_bounds(primitive);
+        mix(hash, 1u);
+        mix(hash, bounds.min);
+        mix(hash, bounds.max);
+    }
+    return hash;
+}
+
+std::string path(const std::string& directory, std::uint64_t key) {
+    char name[24];
+    std::snprintf(name, sizeof(name), "%016llx.bvh", static_cast<unsigned long long>(key));
+    return directory.empty() ? name : directory + '/' + name;
+}
+
+bool load(const std::string& path, std::uint64_t key, std::size_t primitive_count, Bvh& bvh) {
+    trace::Span span("load_bvh_cache");
+
+    Mapping file(path);
+    if (file.data == nullptr || file.size < sizeof(Header)) {
+        return false;
+    }
+    Header header;
+    std::memcpy(&header, file.data, sizeof(header));
+    if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version || header.key != key ||
+        header.primitive_count != primitive_count || header.node_size != sizeof(BvhNode)) {
+        return false;
+    }
+    std::size_t nodes_bytes = std::size_t{header.node_count} * sizeof(BvhNode);
+    std::size_t indices_bytes = std::size_t{header.index_count} * sizeof(std::uint32_t);
+    std::size_t unbounded_bytes = std::size_t{header.unbounded_count} * sizeof(std::uint32_t);
+    if (file.size != sizeof(Header) + nodes_bytes + indices_bytes + unbounded_bytes) {
+        return false;
+    }
+
+    // The header is 40 bytes, so every array in the mapping is 4-byte aligned.
+    const char* cursor = file.data + sizeof(Header);
+    const auto* nodes = reinterpret_cast<const BvhNode*>(cursor);
+    const auto* indices = reinterpret_cast<const std::uint32_t*>(cursor + nodes_bytes);
+    const auto* unbounded = reinterpret_cast<const std::uint32_t*>(cursor + nodes_bytes + indices_bytes);
+    if (!consistent(nodes, header, indices, unbounded)) {
+        return false;
+    }
+    bvh.nodes.assign(nodes, nodes + header.node_count);
+    bvh.indices.assign(indices, indices + header.index_count);
+    bvh.unbounded.assign(unbounded, unbounded + header.unbounded_count);
+    bvh.built_cost = header.built_cost;
+    return true;
+}
+
+bool store(const std::string& path, std::uint64_t key, std::size_t primitive_count, const Bvh& bvh) {
+    trace::Span span("store_bvh_cache");
+
+    std::error_code error;
+    std::filesystem::path target(path);
+    if (target.has_parent_path()) {
+        std::filesystem::create_directories(target.parent_path(), error);
+    }
+    // Unique per process and per call, so threads and processes storing the same key never share a temporary file.
+    static std::atomic<std::uint64_t> counter{0};
+    std::string temporary = path + ".tmp" + std::to_string(getpid()) + "." + std::to_string(counter++);
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            return false;
+        }
+        Header header{};
+        std::memcpy(header.magic, magic, sizeof(magic));
+        header.version = version;
+        header.key = key;
+        header.primitive_count = static_cast<std::uint32_t>(primitive_count);
+        header.node_count = static_cast<std::uint32_t>(bvh.nodes.size());
+        header.index_count = static_cast<std::uint32_t>(bvh.indices.size());
+        header.unbounded_count = static_cast<std::uint32_t>(bvh.unbounded.size());
+        header.built_cost = bvh.built_cost;
+        header.node_size = sizeof(BvhNode);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(bvh.nodes.data()),
+                  static_cast<std::streamsize>(bvh.nodes.size() * sizeof(BvhNode)));
+        out.write(reinterpret_cast<const char*>(bvh.indices.data()),
+                  static_cast<std::streamsize>(bvh.indices.size() * sizeof(std::uint32_t)));
+        out.write(reinterpret_cast<const char*>(bvh.unbounded.data()),
+                  static_cast<std::streamsize>(bvh.unbounded.size() * sizeof(std::uint32_t)));
+        if (!out) {
+            out.close();
+            std::filesystem::remove(temporary, error);
+            return false;
+        }
+    }
+    std::filesystem::rename(temporary, path, error);
+    if (error) {
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
+
+} // namespace engine::bvh_cache
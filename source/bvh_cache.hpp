@@ -0,0 +1,28 @@
+#pragma once
+
+#include "bvh.hpp"
+#include "primitive.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace engine::bvh_cache {
+
+// Bumped whenever the file layout or the build algorithm changes, so stale caches are rebuilt instead of trusted.
+constexpr std::uint32_t version = 1;
+
+// Hash of what Bvh::build reads: the bounds of every primitive (planes only count as unbounded). Changing materials
+// keeps the key, moving or resizing a primitive changes it.
+std::uint64_t key(const std::vector<Shape*>& primitives);
+// "<directory>/<key as 16 hex digits>.bvh"
+std::string path(const std::string& directory, std::uint64_t key);
+
+// Maps the cache file and fills `bvh` from it. Returns false, leaving `bvh` untouched, when the file is missing,
+// truncated, of another version, was built for another key or primitive count, or describes an inconsistent tree.
+bool load(const std::string& path, std::uint64_t key, std::size_t primitive_count, Bvh& bvh);
+// Writes the tree to a temporary file next to `path` and renames it into place, so concurrent renders never map a
+// partial file. Creates the directory if needed. Returns false if the file could not be written.
+bool store(const std::string& path, std::uint64_t key, std::size_t primitive_count, const Bvh& bvh);
+
+} // namespace engine::bvh_cache
@@ -0,0 +1,59 @@
+#include "cpu.hpp"
+
+#include <stdexcept>
+
+namespace engine {
+
+bool isa_supported(ISA isa) {
+#if defined(ENGINE_X86_KERNELS)
+    __builtin_cpu_init();
+    switch (isa) {
+    case ISA::Generic:
+        return true;
+    case ISA::SSE4:
+        return __builtin_cpu_supports("sse4.2");
+    case ISA::AVX2:
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case ISA::AVX512:
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl") &&
+               __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    }
+    return false;
+#else
+    return isa == ISA::Generic;
+#endif
+}
+
+ISA detect_isa() {
+    for (ISA isa : {ISA::AVX512, ISA::AVX2, ISA::SSE4}) {
+        if (isa_supported(isa)) {
+            return isa;
+        }
+    }
+    return ISA::Generic;
+}
+
+ISA parse_isa(const std::string& name) {
+    for (ISA isa : {ISA::Generic, ISA::SSE4, ISA::AVX2, ISA::AVX512}) {
+        if (name == isa_name(isa)) {
+            return isa;
+        }
+    }
+    throw std::runtime_error("Unknown ISA: " + name + " (expected generic, sse4, avx2 or avx512).");
+}
+
+const char* isa_name(ISA isa) {
+    switch (isa) {
+    case ISA::Generic:
+        return "generic";
+    case ISA::SSE4:
+        return "sse4";
+    case ISA::AVX2:
+        return "avx2";
+    case ISA::AVX512:
+        return "avx512";
+    }
+    return "unknown";
+}
+
+} // namespace engine
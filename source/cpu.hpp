@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+
+namespace engine {
+
+// Instruction set levels the SIMD kernels are compiled for, from the x86-64 baseline up.
+enum class ISA { Generic, SSE4, AVX2, AVX512 };
+
+ISA detect_isa();
+bool isa_supported(ISA isa);
+ISA parse_isa(const std::string& name);
+const char* isa_name(ISA isa);
+
+} // namespace engine
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "image.hpp"
+#include "thread_pool.hpp"
+
+#include <cstdint>
+
+namespace engine {
+
+// Edge-avoiding À-Trous wavelet filter (Dammertz et al., 2010) over `width` x `height` pixels of radiance, in place.
+// Five passes of a 5x5 B3-spline kernel whose taps spread 1, 2, 4, 8 and 16 pixels apart; every tap is weighted down
+// by its difference to the center in color, albedo, normal and relative depth, so texture and color edges between
+// surfaces stay sharp. Rows are filtered on the pool when one is given, with the SIMD kernels of the selected ISA.
+void denoise(glm::vec3* radiance,
+             const Aovs& aovs,
+             std::uint32_t width,
+             std::uint32_t height,
+             ThreadPool* pool = nullptr);
+
+} // namespace engine
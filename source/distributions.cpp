@@ -1,22 +1,29 @@
 #include "distributions.hpp"
 #include "glm/geometric.hpp"
 #include "primitive.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <cstdlib>
 #include <random>
 #include <stdexcept>
 
+#include "mesh.hpp"
 #include "ray.hpp"
+#include "utils.hpp"
 
 namespace engine::rand {
 
-Uniform::Uniform()
-    : norm(std::normal_distribution<float>(0.f, 1.f)) {}
+void seed(std::uint64_t seed) {
+    Rng::get_instance().seed(seed);
+    seed_uniform01(mix_seed(seed, 0));
+}
 
-glm::vec3 Uniform::sample(glm::vec3 x, glm::vec3 n) {
+glm::vec3 Uniform::sample(glm::vec3 x, glm::vec3 n, float /*time*/) {
     glm::vec3 sample{
-        norm(Rng::get_instance().gen()), 
-        norm(Rng::get_instance().gen()), 
-        norm(Rng::get_instance().gen())
+        Rng::get_instance().normal_01(),
+        Rng::get_instance().normal_01(),
+        Rng::get_instance().normal_01()
     };
     sample = glm::normalize(sample);
     if (glm::dot(sample, n) < 0) {
@@ -25,37 +32,60 @@ glm::vec3 Uniform::sample(glm::vec3 x, glm::vec3 n) {
     return sample;
 }
 
-float Uniform::pdf(glm::vec3 x, glm::vec3 n, glm::vec3 d) {
+float Uniform::pdf(glm::vec3 x, glm::vec3 n, glm::vec3 d, float /*time*/) {
     if (glm::dot(d, n) < 0) {
         return 0.f;
     }
     return 1.f / (2.f * pi);
 }
 
-Cosine::Cosine()
-    : norm(std::normal_distribution<float>(0.f, 1.f)) {}
-
-glm::vec3 Cosine::sample(glm::vec3 x, glm::vec3 n) {
+glm::vec3 Cosine::sample(glm::vec3 x, glm::vec3 n, float /*time*/) {
     glm::vec3 sample{
-        norm(Rng::get_instance().gen()), 
-        norm(Rng::get_instance().gen()), 
-        norm(Rng::get_instance().gen())
+        Rng::get_instance().normal_01(),
+        Rng::get_instance().normal_01(),
+        Rng::get_instance().normal_01()
     };
     sample = glm::normalize(sample);
     sample += n;
     return 1.f / glm::length(sample) * sample;
 }
 
-float Cosine::pdf(glm::vec3 x, glm::vec3 n, glm::vec3 d) {
+float Cosine::pdf(glm::vec3 x, glm::vec3 n, glm::vec3 d, float /*time*/) {
     return std::max(0.f, glm::dot(d, n) / pi);
 }
 
-Light::Light(Shape* obj) : obj(obj) {}
+Light::Light(Shape* obj) : obj(obj), spherical(false) {
+    if (obj->type == PRIMITIVE_TYPE::Ellipsoid) {
+        glm::vec3 radius = dynamic_cast<Ellipsoid*>(obj)->radius;
+        spherical = std::abs(radius.x - radius.y) <= 1e-6f * radius.x && std::abs(radius.x - radius.z) <= 1e-6f * radius.x;
+    }
+}
+
+bool Light::outside(glm::vec3 x, float time) const {
+    glm::vec3 local = glm::inverse(obj->rotation_at(time)) * (x - obj->position_at(time));
+    if (obj->type == PRIMITIVE_TYPE::Box) {
+        glm::vec3 size = dynamic_cast<Box*>(obj)->size;
+        return std::abs(local.x) > size.x || std::abs(local.y) > size.y || std::abs(local.z) > size.z;
+    }
+    glm::vec3 radius = dynamic_cast<Ellipsoid*>(obj)->radius;
+    return glm::dot(local / radius, local / radius) > 1.f;
+}
+
+float Light::pdf(glm::vec3 x, glm::vec3 n, glm::vec3 d, float time) {
+    if (obj->type == PRIMITIVE_TYPE::Mesh) {
+        return mesh_pdf(x, d, time);
+    }
+    if (obj->type == PRIMITIVE_TYPE::Box && outside(x, time)) {
+        return visible_faces_pdf(x, d, time);
+    }
+    if (spherical && outside(x, time)) {
+        return cone_pdf(x, d, time);
+    }
 
-float Light::pdf(glm::vec3 x, glm::vec3 n, glm::vec3 d) {
     ray::Ray r;
     r.start = x;
     r.direction = d;
+    r.time = time;
 
     auto inter = ray::intersection(r, obj);
     if (!inter.has_value()) {
@@ -67,7 +97,7 @@ float Light::pdf(glm::vec3 x, glm::vec3 n, glm::vec3 d) {
         result += box_pdf(x, d, x + inter->t * d, inter->normal);
     }
     else {
-        result += ellips_pdf(x, d, x + inter->t * d, inter->normal);
+        result += ellips_pdf(x, d, x + inter->t * d, inter->normal, time);
     }
 
     r.start = x + (inter->t + eps) * d;
@@ -81,19 +111,32 @@ float Light::pdf(glm::vec3 x, glm::vec3 n, glm::vec3 d) {
         result += box_pdf(x, d, x + (inter->t + next_inter->t + eps) * d, next_inter->normal);
     }
     else {
-        result += ellips_pdf(x, d, x + (inter->t + next_inter->t + eps) * d, next_inter->normal);
+        result += ellips_pdf(x, d, x + (inter->t + next_inter->t + eps) * d, next_inter->normal, time);
     }
     return result;
 }
 
-glm::vec3 Light::sample(glm::vec3 x, glm::vec3 n) {
+glm::vec3 Light::sample(glm::vec3 x, glm::vec3 n, float time) {
+    if (obj->type == PRIMITIVE_TYPE::Mesh) {
+        return mesh_sample(x, time);
+    }
+    if (obj->type == PRIMITIVE_TYPE::Box && outside(x, time)) {
+        return visible_faces_sample(x, time);
+    }
+    if (spherical && outside(x, time)) {
+        return cone_sample(x, time);
+    }
     switch (obj->type) {
         case PRIMITIVE_TYPE::Box:
-            return box_sample(x, n);
+            return box_sample(x, n, time);
         case PRIMITIVE_TYPE::Ellipsoid:
-            return ellips_sample(x, n);
+            return ellips_sample(x, n, time);
         case PRIMITIVE_TYPE::Plane:
             throw std::runtime_error("Cannot generate sample for Plane");    
+        case PRIMITIVE_TYPE::Mesh:
+            return mesh_sample(x, time);
+        case PRIMITIVE_TYPE::Instance:
+            throw std::runtime_error("Cannot generate sample for Instance");
     }
 }
 
@@ -107,7 +150,7 @@ float Light::box_pdf(glm::vec3 x, glm::vec3 d, glm::vec3 inter_point, glm::vec3
     return numer / denom;
 }
 
-glm::vec3 Light::box_sample(glm::vec3 x, glm::vec3 n) {
+glm::vec3 Light::box_sample(glm::vec3 x, glm::vec3 n, float time) {
     auto box = dynamic_cast<Box*>(obj);
     if (box == nullptr) {
         throw std::runtime_error("Failed to cast shape to Box");
@@ -139,21 +182,22 @@ glm::vec3 Light::box_sample(glm::vec3 x, glm::vec3 n) {
             point.z = edge * box->size.z;
         }
 
-        point = obj->rotation * point;
-        point += obj->position;
+        point = obj->rotation_at(time) * point;
+        point += obj->position_at(time);
 
         return glm::normalize(point - x);
 }
 
-float Light::ellips_pdf(glm::vec3 x, glm::vec3 d, glm::vec3 inter_point, glm::vec3 inter_norm) {
+float Light::ellips_pdf(glm::vec3 x, glm::vec3 d, glm::vec3 inter_point, glm::vec3 inter_norm, float time) {
     auto ellips = dynamic_cast<Ellipsoid*>(obj);
     if (ellips == nullptr) {
         throw std::runtime_error("Failed to cast shape to Ellipsoid");
     }
 
-    glm::vec3 v = inter_point - ellips->position;
-    auto rotation = ellips->rotation * glm::quat{0.0, v.z, v.y, v.z} * 
-        glm::quat{ellips->rotation.w, -1 * ellips->rotation.x, -1 * ellips->rotation.y, -1 * ellips->rotation.z};
+    glm::vec3 v = inter_point - ellips->position_at(time);
+    glm::quat ellips_rotation = ellips->rotation_at(time);
+    auto rotation = ellips_rotation * glm::quat{0.0, v.z, v.y, v.z} * 
+        glm::quat{ellips_rotation.w, -1 * ellips_rotation.x, -1 * ellips_rotation.y, -1 * ellips_rotation.z};
 
     glm::vec3 norm = glm::vec3{
         rotation.x / ellips->radius.x,
@@ -168,7 +212,7 @@ float Light::ellips_pdf(glm::vec3 x, glm::vec3 d, glm::vec3 inter_point, glm::ve
     return pdf * glm::dot(x - inter_point, x - inter_point) / std::abs(glm::dot(d, inter_norm));
 }
 
-glm::vec3 Light::ellips_sample(glm::vec3 x, glm::vec3 n) {
+glm::vec3 Light::ellips_sample(glm::vec3 x, glm::vec3 n, float time) {
     auto ellips = dynamic_cast<Ellipsoid*>(obj);
     if (ellips == nullptr) {
         throw std::runtime_error("Failed to cast shape to Ellipsoid");
@@ -180,23 +224,180 @@ glm::vec3 Light::ellips_sample(glm::vec3 x, glm::vec3 n) {
         Rng::get_instance().normal_01()
     ));
     point *= ellips->radius;
-    point = ellips->rotation * point + ellips->position;
+    point = ellips->rotation_at(time) * point + ellips->position_at(time);
+
+    return glm::normalize(point - x);
+}
+
+namespace {
+
+// 1 - cos of the half angle of the cone a sphere of the given radius subtends at distance sqrt(dist2), without the
+// cancellation of computing the cosine first.
+float cone_one_minus_cos(float radius, float dist2) {
+    float sin2 = std::min(radius * radius / dist2, 1.f);
+    return sin2 / (1.f + std::sqrt(1.f - sin2));
+}
+
+// Weights of the six box faces (+x, -x, +y, -y, +z, -z) seen from a local point outside the box: face area times the
+// cosine at its center over the squared distance, 0 for faces turned away.
+std::array<float, 6> face_weights(glm::vec3 local, glm::vec3 size) {
+    std::array<float, 6> weights{};
+    for (int axis = 0; axis < 3; ++axis) {
+        int u = (axis + 1) % 3;
+        int v = (axis + 2) % 3;
+        float area = 4.f * size[u] * size[v];
+        for (int side = 0; side < 2; ++side) {
+            float sign = side == 0 ? 1.f : -1.f;
+            float height = sign * local[axis] - size[axis];
+            if (height <= 0.f) {
+                continue;
+            }
+            glm::vec3 to_center = local;
+            to_center[axis] -= sign * size[axis];
+            float dist2 = glm::dot(to_center, to_center);
+            weights[axis * 2 + side] = area * height / (dist2 * std::sqrt(dist2));
+        }
+    }
+    return weights;
+}
+
+} // namespace
+
+float Light::cone_pdf(glm::vec3 x, glm::vec3 d, float time) {
+    float radius = dynamic_cast<Ellipsoid*>(obj)->radius.x;
+    glm::vec3 to_center = obj->position_at(time) - x;
+    float dist2 = glm::dot(to_center, to_center);
+    float one_minus_cos = cone_one_minus_cos(radius, dist2);
+    if (glm::dot(d, to_center) < (1.f - one_minus_cos) * std::sqrt(dist2 * glm::dot(d, d))) {
+        return 0.f;
+    }
+    return 1.f / (2.f * pi * one_minus_cos);
+}
+
+glm::vec3 Light::cone_sample(glm::vec3 x, float time) {
+    float radius = dynamic_cast<Ellipsoid*>(obj)->radius.x;
+    glm::vec3 to_center = obj->position_at(time) - x;
+    float dist2 = glm::dot(to_center, to_center);
+    glm::vec3 w = to_center / std::sqrt(dist2);
+    glm::vec3 u = glm::normalize(glm::cross(std::abs(w.x) > 0.5f ? glm::vec3{0.f, 1.f, 0.f} : glm::vec3{1.f, 0.f, 0.f}, w));
+    glm::vec3 v = glm::cross(w, u);
+
+    float one_minus_cos = Rng::get_instance().uniform_01() * cone_one_minus_cos(radius, dist2);
+    float cos_theta = 1.f - one_minus_cos;
+    float sin_theta = std::sqrt(std::max(0.f, one_minus_cos * (2.f - one_minus_cos)));
+    float phi = 2.f * pi * Rng::get_instance().uniform_01();
+    return glm::normalize(sin_theta * std::cos(phi) * u + sin_theta * std::sin(phi) * v + cos_theta * w);
+}
+
+float Light::visible_faces_pdf(glm::vec3 x, glm::vec3 d, float time) {
+    glm::vec3 size = dynamic_cast<Box*>(obj)->size;
+    glm::quat inverse = glm::inverse(obj->rotation_at(time));
+    glm::vec3 local = inverse * (x - obj->position_at(time));
+    glm::vec3 local_d = inverse * d;
+    std::array<float, 6> weights = face_weights(local, size);
+    float weight_sum = weights[0] + weights[1] + weights[2] + weights[3] + weights[4] + weights[5];
+
+    // From outside a direction enters the box through at most one face that points towards x, and only those faces
+    // are ever sampled, so the plane of each visible face is enough: no intersection with the box is needed.
+    for (int face = 0; face < 6; ++face) {
+        if (weights[face] == 0.f) {
+            continue;
+        }
+        int axis = face / 2;
+        float sign = face % 2 == 0 ? 1.f : -1.f;
+        if (local_d[axis] * sign >= 0.f) {
+            continue;
+        }
+        float t = (sign * size[axis] - local[axis]) / local_d[axis];
+        glm::vec3 point = local + t * local_d;
+        int u = (axis + 1) % 3;
+        int v = (axis + 2) % 3;
+        if (std::abs(point[u]) > size[u] || std::abs(point[v]) > size[v]) {
+            continue;
+        }
+        float area = 4.f * size[u] * size[v];
+        float length2 = glm::dot(local_d, local_d);
+        return weights[face] / weight_sum / area * t * t * length2 * std::sqrt(length2) / std::abs(local_d[axis]);
+    }
+    return 0.f;
+}
 
+glm::vec3 Light::visible_faces_sample(glm::vec3 x, float time) {
+    glm::vec3 size = dynamic_cast<Box*>(obj)->size;
+    glm::quat rotation = obj->rotation_at(time);
+    glm::vec3 position = obj->position_at(time);
+    glm::vec3 local = glm::inverse(rotation) * (x - position);
+    std::array<float, 6> weights = face_weights(local, size);
+    float weight_sum = weights[0] + weights[1] + weights[2] + weights[3] + weights[4] + weights[5];
+
+    float target = Rng::get_instance().uniform_01() * weight_sum;
+    int face = -1;
+    for (int candidate = 0; candidate < 6; ++candidate) {
+        if (weights[candidate] == 0.f) {
+            continue;
+        }
+        face = candidate;
+        if (target < weights[candidate]) {
+            break;
+        }
+        target -= weights[candidate];
+    }
+    int axis = face / 2;
+    glm::vec3 point{
+        (2 * Rng::get_instance().uniform_01() - 1) * size.x,
+        (2 * Rng::get_instance().uniform_01() - 1) * size.y,
+        (2 * Rng::get_instance().uniform_01() - 1) * size.z
+    };
+    point[axis] = (face % 2 == 0 ? 1.f : -1.f) * size[axis];
+    point = rotation * point + position;
     return glm::normalize(point - x);
 }
 
 Mix::Mix(std::vector<std::unique_ptr<IDistribution>>&& distrs) : distrs(std::move(distrs)) {}
 
-glm::vec3 Mix::sample(glm::vec3 x, glm::vec3 n) {
-    return distrs[Rng::get_instance().choice(distrs.size())]->sample(x, n);
+glm::vec3 Mix::sample(glm::vec3 x, glm::vec3 n, float time) {
+    return distrs[Rng::get_instance().choice(distrs.size())]->sample(x, n, time);
 }
 
-float Mix::pdf(glm::vec3 x, glm::vec3 n, glm::vec3 d) {
+float Mix::pdf(glm::vec3 x, glm::vec3 n, glm::vec3 d, float time) {
     float pdf = 0;
     for (auto& distr : distrs) {
-        pdf += distr->pdf(x, n, d);
+        pdf += distr->pdf(x, n, d, time);
     }
     return pdf / static_cast<float>(distrs.size());
 }
 
+float Light::mesh_pdf(glm::vec3 x, glm::vec3 d, float time) {
+    constexpr int max_crossings = 64;
+    const MeshData& mesh = *dynamic_cast<Mesh*>(obj)->data;
+    glm::quat reversed_rotation = glm::inverse(obj->rotation_at(time));
+    glm::vec3 start = reversed_rotation * (x - obj->position_at(time));
+    glm::vec3 direction = glm::normalize(reversed_rotation * d);
+
+    float result = 0.f;
+    float distance = 0.f;
+    for (int i = 0; i < max_crossings; ++i) {
+        auto hit = intersect_mesh(mesh, start, direction);
+        if (!hit.has_value()) {
+            break;
+        }
+        distance += hit->t;
+        float cosine = std::abs(glm::dot(direction, triangle_normal(mesh, hit->triangle)));
+        result += distance * distance / (mesh.area * cosine);
+        start += (hit->t + eps) * direction;
+        distance += eps;
+    }
+    return result;
+}
+
+glm::vec3 Light::mesh_sample(glm::vec3 x, float time) {
+    Rng& rng = Rng::get_instance();
+    std::array<float, 4> u;
+    for (float& value : u) {
+        value = rng.uniform_01();
+    }
+    glm::vec3 point = sample_mesh(*dynamic_cast<Mesh*>(obj)->data, u[0], u[1], u[2], u[3]);
+    return glm::normalize(obj->rotation_at(time) * point + obj->position_at(time) - x);
+}
+
 } // namespace engine::rand
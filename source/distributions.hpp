@@ -21,83 +21,110 @@ public:
     }
 
     std::minstd_rand& gen() {
-        thread_local std::random_device rd;
-        thread_local std::minstd_rand gen(rd());
-        return gen;
+        return state().gen;
     }
 
     float uniform_01() {
-        thread_local std::uniform_real_distribution<float> uniform {0.f, 1.f};
-        return uniform(gen());
+        return state().uniform(state().gen);
     }
 
     float normal_01() {
-        thread_local std::normal_distribution<float> normal {0.f, 1.f};
-        return normal(gen());
+        return state().normal(state().gen);
     }
 
     int choice(std::size_t size) {
         return static_cast<int>(size * uniform_01());
     }
 
+    // Restarts the calling thread's generator, dropping any value the distributions keep between calls.
+    void seed(std::uint64_t seed) {
+        State& s = state();
+        s.gen.seed(static_cast<std::minstd_rand::result_type>(seed % (std::minstd_rand::modulus - 1) + 1));
+        s.uniform.reset();
+        s.normal.reset();
+    }
+
 private:
+    struct State {
+        std::minstd_rand gen{std::random_device{}()};
+        std::uniform_real_distribution<float> uniform{0.f, 1.f};
+        std::normal_distribution<float> normal{0.f, 1.f};
+    };
+
+    static State& state() {
+        thread_local State s;
+        return s;
+    }
+
     Rng() = default;
     Rng(const Rng&) = delete;
     Rng& operator=(const Rng&) = delete;
 };
 
+// Restarts every random stream of the calling thread (Rng and rand_uniform01) from the seed.
+void seed(std::uint64_t seed);
+
+// Directions from x on a surface with normal n. `time` is that of the ray in the shutter interval: moving emitters are
+// sampled where they are at that moment.
 class IDistribution {
 public:
     virtual ~IDistribution() = default;
-    virtual glm::vec3 sample(glm::vec3 x, glm::vec3 n) = 0;
-    virtual float pdf(glm::vec3 x, glm::vec3 n, glm::vec3 d) = 0;
+    virtual glm::vec3 sample(glm::vec3 x, glm::vec3 n, float time) = 0;
+    virtual float pdf(glm::vec3 x, glm::vec3 n, glm::vec3 d, float time) = 0;
 };
 
 class Uniform : public IDistribution {
 public:
-    Uniform();
-
-    glm::vec3 sample(glm::vec3 x, glm::vec3 n) final;
-    float pdf(glm::vec3 x, glm::vec3 n, glm::vec3 d) final;
-
-private:
-    std::normal_distribution<float> norm;
+    glm::vec3 sample(glm::vec3 x, glm::vec3 n, float time) final;
+    float pdf(glm::vec3 x, glm::vec3 n, glm::vec3 d, float time) final;
 };
 
 class Cosine : public IDistribution {
 public:
-    Cosine();
-
-    glm::vec3 sample(glm::vec3 x, glm::vec3 n) final;
-    float pdf(glm::vec3 x, glm::vec3 n, glm::vec3 d) final;
-
-private:
-    std::normal_distribution<float> norm;
+    glm::vec3 sample(glm::vec3 x, glm::vec3 n, float time) final;
+    float pdf(glm::vec3 x, glm::vec3 n, glm::vec3 d, float time) final;
 };
 
 class Light : public IDistribution {
 public:
     Light(Shape* obj);
 
-    float pdf(glm::vec3 x, glm::vec3 n, glm::vec3 d) final;
-    glm::vec3 sample(glm::vec3 x, glm::vec3 n) final;
+    float pdf(glm::vec3 x, glm::vec3 n, glm::vec3 d, float time) final;
+    glm::vec3 sample(glm::vec3 x, glm::vec3 n, float time) final;
 
     float box_pdf(glm::vec3 x, glm::vec3 d, glm::vec3 inter_point, glm::vec3 inter_norm);
-    glm::vec3 box_sample(glm::vec3 x, glm::vec3 n);
+    glm::vec3 box_sample(glm::vec3 x, glm::vec3 n, float time);
     
-    float ellips_pdf(glm::vec3 x, glm::vec3 d, glm::vec3 inter_point, glm::vec3 inter_norm);
-    glm::vec3 ellips_sample(glm::vec3 x, glm::vec3 n);
+    float ellips_pdf(glm::vec3 x, glm::vec3 d, glm::vec3 inter_point, glm::vec3 inter_norm, float time);
+    glm::vec3 ellips_sample(glm::vec3 x, glm::vec3 n, float time);
+
+    // Solid angle sampling of a spherical ellipsoid seen from outside: uniform in the cone it subtends.
+    float cone_pdf(glm::vec3 x, glm::vec3 d, float time);
+    glm::vec3 cone_sample(glm::vec3 x, float time);
+
+    // Box seen from outside: a face that points towards x, then a uniform point on it. Faces are weighted by their
+    // approximate solid angle, back faces are never sampled.
+    float visible_faces_pdf(glm::vec3 x, glm::vec3 d, float time);
+    glm::vec3 visible_faces_sample(glm::vec3 x, float time);
+
+    // Mesh: a triangle picked by area, then a uniform point on it. The pdf adds up every triangle the direction
+    // crosses, since a mesh need not be convex.
+    float mesh_pdf(glm::vec3 x, glm::vec3 d, float time);
+    glm::vec3 mesh_sample(glm::vec3 x, float time);
 
 private:
-    Shape* obj;    
+    bool outside(glm::vec3 x, float time) const;
+
+    Shape* obj;
+    bool spherical;
 };
 
 class Mix : public IDistribution {
 public:
     Mix(std::vector<std::unique_ptr<IDistribution>>&& distrs);
 
-    float pdf(glm::vec3 x, glm::vec3 n, glm::vec3 d) final;
-    glm::vec3 sample(glm::vec3 x, glm::vec3 n) final;
+    float pdf(glm::vec3 x, glm::vec3 n, glm::vec3 d, float time) final;
+    glm::vec3 sample(glm::vec3 x, glm::vec3 n, float time) final;
 
 private:
     std::vector<std::unique_ptr<IDistribution>> distrs;
@@ -0,0 +1,480 @@
+#include "farm.hpp"
+#include "io.hpp"
+#include "net.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <list>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+
+namespace engine::farm {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Seconds a connected peer may stall in the middle of a message before it is dropped.
+constexpr double message_timeout = 10.0;
+// Longest error text a worker may send with a failed task.
+constexpr std::uint64_t max_message_size = 1u << 16;
+
+// One band of rows over one slice of the samples.
+struct Piece {
+    Region region;
+    std::uint32_t first = 0;
+    std::uint32_t last = 0;
+    bool done = false;
+    std::uint32_t failures = 0;
+    // Ids of the workers the piece failed on.
+    std::vector<std::uint32_t> failed_on;
+    // Workers rendering the piece right now, and since when the oldest of them does.
+    std::uint32_t running = 0;
+    Clock::time_point started;
+};
+
+struct Worker {
+    std::uint32_t id;
+    net::Socket socket;
+    std::optional<std::uint32_t> task;
+    Clock::time_point started;
+};
+
+std::size_t payload_size(const Piece& piece) {
+    const std::size_t pixels = piece.region.size();
+    return piece.last == 0 ? pixels * sizeof(glm::vec3)
+                           : pixels * (3 * sizeof(std::int64_t) + sizeof(std::uint32_t));
+}
+
+void send_task(const Worker& worker, std::uint32_t id, const Piece& piece) {
+    Task task{id, {piece.region.x0, piece.region.y0, piece.region.x1, piece.region.y1}, piece.first, piece.last, 0};
+    net::write_all(worker.socket.get(), &task, sizeof(task));
+}
+
+void send_result(int fd, std::uint32_t id, std::uint32_t status, const void* data, std::size_t size) {
+    Result result{id, status, size};
+    net::write_all(fd, &result, sizeof(result));
+    net::write_all(fd, data, size);
+}
+
+class Coordinator {
+public:
+    Coordinator(const Scene& scene,
+                const RenderOptions& options,
+                LIGHT_SAMPLING light_sampling,
+                const CoordinatorOptions& settings)
+        : settings(settings) {
+        const std::uint32_t samples = options.samples != 0 ? options.samples : scene.samples;
+        if (settings.slices > 1 && !options.seed.has_value()) {
+            throw std::runtime_error("Sample slices need a seed.");
+        }
+        const std::uint32_t tiles = std::clamp(settings.tiles, 1u, scene.height);
+        const std::uint32_t slices = std::clamp(settings.slices, 1u, std::max(samples, 1u));
+        for (std::uint32_t t = 0; t < tiles; ++t) {
+            for (std::uint32_t s = 0; s < slices; ++s) {
+                Piece piece;
+                piece.region = shard::tile_region(scene.width, scene.height, t, tiles);
+                if (slices > 1) {
+                    std::tie(piece.first, piece.last) = shard::sample_slice(samples, s, slices);
+                }
+                queue.push_back(static_cast<std::uint32_t>(pieces.size()));
+                pieces.push_back(piece);
+            }
+        }
+
+        result.width = scene.width;
+        result.height = scene.height;
+        result.region = Region{0, 0, scene.width, scene.height};
+        if (slices > 1) {
+            accumulation.resize(result.region.size());
+        }
+        else {
+            result.radiance.resize(result.region.size());
+        }
+
+        std::ostringstream bytes;
+        io::write_binary_scene(bytes, scene);
+        scene_bytes = bytes.str();
+        job = Job{farm_magic,
+                  protocol_version,
+                  scene_bytes.size(),
+                  samples,
+                  options.seed.has_value() ? 1u : 0u,
+                  options.seed.value_or(0),
+                  static_cast<std::uint32_t>(options.integrator),
+                  static_cast<std::uint32_t>(options.packet_width),
+                  static_cast<std::uint32_t>(light_sampling),
+                  0};
+    }
+
+    shard::Partial run(const std::function<void(std::uint16_t port)>& listening) {
+        trace::Span span("coordinate");
+        net::Socket listener = net::listen_tcp(settings.address, settings.port);
+        const std::uint16_t port = net::local_port(listener);
+        if (settings.verbose) {
+            std::cout << "coordinating " << pieces.size() << " tasks on " << settings.address << ':' << port
+                      << std::endl;
+        }
+        if (listening) {
+            listening(port);
+        }
+
+        std::vector<pollfd> fds;
+        while (finished < pieces.size()) {
+            fds.assign(1, pollfd{listener.get(), POLLIN, 0});
+            for (const Worker& worker : workers) {
+                fds.push_back(pollfd{worker.socket.get(), POLLIN, 0});
+            }
+            if (poll(fds.data(), fds.size(), 100) < 0) {
+                continue;
+            }
+            if ((fds[0].revents & POLLIN) != 0) {
+                accept_worker(listener);
+            }
+            auto worker = workers.begin();
+            for (std::size_t i = 1; i < fds.size(); ++i) {
+                auto next = std::next(worker);
+                if (fds[i].revents != 0) {
+                    receive(worker);
+                }
+                worker = next;
+            }
+            if (!failure.empty()) {
+                throw std::runtime_error(failure);
+            }
+            assign();
+        }
+
+        for (const Worker& worker : workers) {
+            Task stop{};
+            try {
+                net::write_all(worker.socket.get(), &stop, sizeof(stop));
+            }
+            catch (const std::runtime_error&) {
+            }
+        }
+        workers.clear();
+        if (!accumulation.count.empty()) {
+            result.radiance.resize(result.region.size());
+            for (std::size_t i = 0; i < result.radiance.size(); ++i) {
+                result.radiance[i] = accumulation.mean(i);
+            }
+        }
+        return std::move(result);
+    }
+
+private:
+    void log(const std::string& message) const {
+        if (settings.verbose) {
+            std::cout << message << std::endl;
+        }
+    }
+
+    void accept_worker(const net::Socket& listener) {
+        net::Socket socket(accept(listener.get(), nullptr, nullptr));
+        if (socket.get() < 0) {
+            return;
+        }
+        net::set_timeout(socket, message_timeout);
+        try {
+            Hello hello{};
+            if (!net::read_all(socket.get(), &hello, sizeof(hello)) || hello.magic != farm_magic ||
+                hello.version != protocol_version) {
+                return;
+            }
+            net::write_all(socket.get(), &job, sizeof(job));
+            net::write_all(socket.get(), scene_bytes.data(), scene_bytes.size());
+            workers.push_back(Worker{next_worker, std::move(socket), std::nullopt, {}});
+            log("worker " + std::to_string(next_worker) + " joined with " + std::to_string(hello.threads) +
+                " threads");
+            ++next_worker;
+        }
+        catch (const std::runtime_error&) {
+        }
+    }
+
+    // The worker's copy of its task is gone: put the task back in the queue unless another copy is still running.
+    void release(Worker& worker) {
+        if (!worker.task.has_value()) {
+            return;
+        }
+        Piece& piece = pieces[worker.task.value()];
+        --piece.running;
+        if (!piece.done && piece.running == 0) {
+            queue.push_front(worker.task.value());
+        }
+        worker.task.reset();
+    }
+
+    void drop(std::list<Worker>::iterator worker, const std::string& reason) {
+        log("worker " + std::to_string(worker->id) + " dropped: " + reason +
+            (worker->task.has_value() ? ", task " + std::to_string(worker->task.value()) + " released" : ""));
+        release(*worker);
+        workers.erase(worker);
+    }
+
+    void receive(std::list<Worker>::iterator worker) {
+        try {
+            Result header{};
+            if (!net::read_all(worker->socket.get(), &header, sizeof(header))) {
+                drop(worker, "disconnected");
+                return;
+            }
+            if (!worker->task.has_value() || header.id != worker->task.value()) {
+                drop(worker, "answered a task it was not given");
+                return;
+            }
+            const std::uint32_t id = header.id;
+            Piece& piece = pieces[id];
+            if (header.status != 0) {
+                if (header.size > max_message_size) {
+                    drop(worker, "sent an error message that is too long");
+                    return;
+                }
+                std::string message(header.size, '\0');
+                net::read_all(worker->socket.get(), message.data(), message.size());
+                log("task " + std::to_string(id) + " failed on worker " + std::to_string(worker->id) + ": " + message);
+                piece.failed_on.push_back(worker->id);
+                release(*worker);
+                if (++piece.failures >= settings.max_failures) {
+                    failure = "Task " + std::to_string(id) + " failed " + std::to_string(piece.failures) +
+                              " times: " + message;
+                }
+                return;
+            }
+            if (header.size != payload_size(piece)) {
+                drop(worker, "sent a result of the wrong size");
+                return;
+            }
+            payload.resize(header.size);
+            net::read_all(worker->socket.get(), payload.data(), payload.size());
+            const double seconds = std::chrono::duration<double>(Clock::now() - worker->started).count();
+            --piece.running;
+            worker->task.reset();
+            if (piece.done) {
+                return;
+            }
+            store(piece);
+            piece.done = true;
+            ++finished;
+            longest_task = std::max(longest_task, seconds);
+            log("task " + std::to_string(id) + " done by worker " + std::to_string(worker->id) + " in " +
+                std::to_string(seconds) + " s (" + std::to_string(finished) + '/' + std::to_string(pieces.size()) +
+                ')');
+        }
+        catch (const std::runtime_error& e) {
+            drop(worker, e.what());
+        }
+    }
+
+    void store(const Piece& piece) {
+        const Region& region = piece.region;
+        const std::size_t pixels = region.size();
+        for (std::size_t i = 0; i < pixels; ++i) {
+            const std::size_t pixel =
+                (region.y0 + i / region.width()) * static_cast<std::size_t>(result.width) + region.x0 +
+                i % region.width();
+            if (piece.last == 0) {
+                std::copy_n(payload.data() + i * sizeof(glm::vec3), sizeof(glm::vec3),
+                            reinterpret_cast<char*>(&result.radiance[pixel]));
+                continue;
+            }
+            std::int64_t sum[3];
+            std::uint32_t count;
+            std::copy_n(payload.data() + i * sizeof(sum), sizeof(sum), reinterpret_cast<char*>(sum));
+            std::copy_n(payload.data() + pixels * sizeof(sum) + i * sizeof(count), sizeof(count),
+                        reinterpret_cast<char*>(&count));
+            for (int c = 0; c < 3; ++c) {
+                accumulation.sum[3 * pixel + c] += sum[c];
+            }
+            accumulation.count[pixel] += count;
+        }
+    }
+
+    // A task may go to a worker it failed on only once it failed on every connected worker.
+    bool eligible(const Piece& piece, const Worker& worker) const {
+        auto failed = [&](std::uint32_t id) {
+            return std::find(piece.failed_on.begin(), piece.failed_on.end(), id) != piece.failed_on.end();
+        };
+        return !failed(worker.id) ||
+               std::all_of(workers.begin(), workers.end(), [&](const Worker& other) { return failed(other.id); });
+    }
+
+    // The first queued task the worker is eligible for, taken off the queue.
+    std::optional<std::uint32_t> take(const Worker& worker) {
+        for (auto it = queue.begin(); it != queue.end(); ++it) {
+            if (eligible(pieces[*it], worker)) {
+                std::uint32_t id = *it;
+                queue.erase(it);
+                return id;
+            }
+        }
+        return std::nullopt;
+    }
+
+    // The running piece the worker is eligible for that has been running longest past the timeout and has a single
+    // copy, if any.
+    std::optional<std::uint32_t> overdue(const Worker& worker, Clock::time_point now) const {
+        const double timeout = settings.task_timeout > 0.0 ? settings.task_timeout : 3.0 * longest_task;
+        if (timeout <= 0.0) {
+            return std::nullopt;
+        }
+        std::optional<std::uint32_t> oldest;
+        for (std::uint32_t id = 0; id < pieces.size(); ++id) {
+            const Piece& piece = pieces[id];
+            if (piece.done || piece.running != 1 || !eligible(piece, worker) ||
+                std::chrono::duration<double>(now - piece.started).count() < timeout) {
+                continue;
+            }
+            if (!oldest.has_value() || piece.started < pieces[oldest.value()].started) {
+                oldest = id;
+            }
+        }
+        return oldest;
+    }
+
+    void assign() {
+        for (auto worker = workers.begin(); worker != workers.end();) {
+            auto next = std::next(worker);
+            if (worker->task.has_value()) {
+                worker = next;
+                continue;
+            }
+            const Clock::time_point now = Clock::now();
+            std::optional<std::uint32_t> id = take(*worker);
+            if (!id.has_value() && queue.empty() && (id = overdue(*worker, now)).has_value()) {
+                log("task " + std::to_string(id.value()) + " is overdue, copied to worker " +
+                    std::to_string(worker->id));
+            }
+            if (!id.has_value()) {
+                worker = next;
+                continue;
+            }
+            Piece& piece = pieces[id.value()];
+            if (piece.running++ == 0) {
+                piece.started = now;
+            }
+            worker->task = id;
+            worker->started = now;
+            try {
+                send_task(*worker, id.value(), piece);
+            }
+            catch (const std::runtime_error& e) {
+                drop(worker, e.what());
+            }
+            worker = next;
+        }
+    }
+
+    const CoordinatorOptions& settings;
+    std::vector<Piece> pieces;
+    std::deque<std::uint32_t> queue;
+    std::size_t finished = 0;
+    double longest_task = 0.0;
+    // Set when a task failed too often; ends the render.
+    std::string failure;
+    std::list<Worker> workers;
+    std::uint32_t next_worker = 0;
+    std::string scene_bytes;
+    Job job{};
+    std::vector<char> payload;
+    shard::Partial result;
+    Accumulation accumulation;
+};
+
+} // namespace
+
+shard::Partial coordinate(const Scene& scene,
+                          const RenderOptions& options,
+                          LIGHT_SAMPLING light_sampling,
+                          const CoordinatorOptions& settings,
+                          const std::function<void(std::uint16_t port)>& listening) {
+    if (options.cost_map != nullptr || options.aovs != nullptr || options.denoise || options.accumulation != nullptr ||
+        !options.region.empty()) {
+        throw std::runtime_error("Farm renders do not support heatmaps, AOVs, denoising or regions.");
+    }
+    Coordinator coordinator(scene, options, light_sampling, settings);
+    return coordinator.run(listening);
+}
+
+void work(const std::string& host, std::uint16_t port, Renderer& renderer, const std::string& bvh_cache, bool verbose) {
+    net::Socket connection = net::connect_tcp(host, port, 100);
+    const int fd = connection.get();
+    Hello hello{farm_magic, protocol_version, static_cast<std::uint32_t>(renderer.threads()), 0};
+    net::write_all(fd, &hello, sizeof(hello));
+    Job job{};
+    if (!net::read_all(fd, &job, sizeof(job))) {
+        return;
+    }
+    if (job.magic != farm_magic || job.version != protocol_version ||
+        job.light_sampling > static_cast<std::uint32_t>(LIGHT_SAMPLING::Power) || job.integrator > 1) {
+        throw std::runtime_error("Unknown protocol.");
+    }
+    std::string bytes(job.scene_size, '\0');
+    net::read_all(fd, bytes.data(), bytes.size());
+    Scene scene = [&] {
+        trace::Span span("load_scene");
+        std::istringstream in(bytes);
+        return io::parse_scene(in, static_cast<LIGHT_SAMPLING>(job.light_sampling), "", bvh_cache);
+    }();
+    std::string().swap(bytes);
+    if (verbose) {
+        std::cout << "working on a " << scene.width << 'x' << scene.height << " scene" << std::endl;
+    }
+
+    Task task{};
+    while (net::read_all(fd, &task, sizeof(task))) {
+        RenderOptions options;
+        options.samples = job.samples;
+        if (job.has_seed != 0) {
+            options.seed = job.seed;
+        }
+        options.integrator = static_cast<INTEGRATOR>(job.integrator);
+        options.packet_width = job.packet_width;
+        options.region = Region{task.region[0], task.region[1], task.region[2], task.region[3]};
+        if (options.region.empty()) {
+            break;
+        }
+        Accumulation accumulation;
+        accumulation.first = task.first;
+        accumulation.last = task.last;
+        if (task.last != 0) {
+            options.accumulation = &accumulation;
+        }
+        HdrImage hdr;
+        try {
+            hdr.resize(resolve_region(scene, options).size());
+            renderer.render(scene, options, &hdr.data()->x);
+        }
+        catch (const std::runtime_error& e) {
+            const std::string message(e.what());
+            send_result(fd, task.id, 1, message.data(), message.size());
+            continue;
+        }
+        if (task.last == 0) {
+            send_result(fd, task.id, 0, hdr.data(), hdr.size() * sizeof(glm::vec3));
+        }
+        else {
+            const std::size_t sums = accumulation.sum.size() * sizeof(std::int64_t);
+            const std::size_t counts = accumulation.count.size() * sizeof(std::uint32_t);
+            Result result{task.id, 0, sums + counts};
+            net::write_all(fd, &result, sizeof(result));
+            net::write_all(fd, accumulation.sum.data(), sums);
+            net::write_all(fd, accumulation.count.data(), counts);
+        }
+        if (verbose) {
+            std::cout << "task " << task.id << " done" << std::endl;
+        }
+    }
+}
+
+} // namespace engine::farm
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "image.hpp"
+#include "raytracer.hpp"
+#include "scene.hpp"
+#include "shard.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace engine::farm {
+
+// Wire format between a coordinator and its workers over TCP. Fields travel in host byte order, so all machines of a
+// farm must share it (every supported target is little-endian).
+//
+// A worker connects and sends Hello. The coordinator answers with Job and job.scene_size bytes of the scene in the
+// binary format (meshes embedded), then sends one Task at a time; each is answered with a Result. A task with an
+// empty region tells the worker to disconnect. Result payload on success: for a task over all samples (first and
+// last 0) 3 floats of radiance per pixel of the region, row by row; for a sample slice 3 int64 fixed point sums and
+// one uint32 sample count per pixel (see Accumulation). On failure: result.size bytes of error text.
+constexpr std::uint32_t farm_magic = 0x57465452;  // "RTFW"
+constexpr std::uint32_t protocol_version = 1;
+
+struct Hello {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint32_t threads;
+    std::uint32_t reserved;
+};
+
+struct Job {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint64_t scene_size;
+    std::uint32_t samples;
+    std::uint32_t has_seed;
+    std::uint64_t seed;
+    std::uint32_t integrator;
+    std::uint32_t packet_width;
+    std::uint32_t light_sampling;
+    std::uint32_t reserved;
+};
+
+struct Task {
+    std::uint32_t id;
+    std::uint32_t region[4];
+    std::uint32_t first;
+    std::uint32_t last;
+    std::uint32_t reserved;
+};
+
+struct Result {
+    std::uint32_t id;
+    // 0 on success.
+    std::uint32_t status;
+    std::uint64_t size;
+};
+
+struct CoordinatorOptions {
+    // IPv4 address and port to listen on; port 0 picks a free one.
+    std::string address = "127.0.0.1";
+    std::uint16_t port = 0;
+    // Bands of rows the frame is cut into, and slices of the sample range each band is cut into.
+    std::uint32_t tiles = 16;
+    std::uint32_t slices = 1;
+    // Seconds a task may run before an idle worker is given a copy of it; 0 waits three times the longest task done
+    // so far. The first copy to finish wins.
+    double task_timeout = 0.0;
+    // A task that fails this many times fails the render. A failed task goes to a worker it has not failed on yet; it
+    // is retried on one it failed on only when every connected worker has failed it.
+    std::uint32_t max_failures = 3;
+    bool verbose = false;
+};
+
+// Renders the scene on the workers that connect and returns the full image. Tasks of dead workers go back to the
+// queue; once the queue is empty, idle workers take copies of tasks running past the timeout. `listening` is called
+// with the port once the coordinator accepts connections. With slices the options need a seed. Throws if a task
+// fails too often.
+shard::Partial coordinate(const Scene& scene,
+                          const RenderOptions& options,
+                          LIGHT_SAMPLING light_sampling,
+                          const CoordinatorOptions& settings,
+                          const std::function<void(std::uint16_t port)>& listening = {});
+
+// Connects to a coordinator, retrying for a few seconds, and renders its tasks on the renderer until told to stop.
+void work(const std::string& host,
+          std::uint16_t port,
+          Renderer& renderer,
+          const std::string& bvh_cache = "",
+          bool verbose = false);
+
+} // namespace engine::farm
@@ -0,0 +1,108 @@
+#include "flat.hpp"
+#include "glm/gtc/quaternion.hpp"
+#include "glm/mat3x3.hpp"
+#include "kernels.hpp"
+
+namespace engine {
+
+namespace {
+
+constexpr std::size_t W = PrimitiveBlock::width;
+
+PrimitiveRecord make_record(const Shape* shape) {
+    PrimitiveRecord record{};
+    record.type = shape->type;
+    glm::mat3 m = glm::mat3_cast(glm::inverse(shape->rotation));
+    for (int row = 0; row < 3; ++row) {
+        record.position[row] = shape->position[row];
+        for (int col = 0; col < 3; ++col) {
+            record.rotation[row * 3 + col] = m[col][row];
+        }
+    }
+
+    glm::vec3 extent{};
+    switch (shape->type) {
+    case PRIMITIVE_TYPE::Plane:
+        extent = dynamic_cast<const Plane*>(shape)->normal;
+        break;
+    case PRIMITIVE_TYPE::Ellipsoid:
+        extent = 1.f / dynamic_cast<const Ellipsoid*>(shape)->radius;
+        break;
+    case PRIMITIVE_TYPE::Box:
+        extent = dynamic_cast<const Box*>(shape)->size;
+        break;
+    case PRIMITIVE_TYPE::Mesh:
+    case PRIMITIVE_TYPE::Instance:
+        break;
+    }
+    for (int axis = 0; axis < 3; ++axis) {
+        record.extent[axis] = extent[axis];
+    }
+    return record;
+}
+
+void append(std::vector<PrimitiveBlock>& blocks, const PrimitiveRecord& record, std::uint32_t index) {
+    if (blocks.empty() || blocks.back().type != record.type || blocks.back().count == W) {
+        PrimitiveBlock block{};
+        block.type = record.type;
+        block.count = 0;
+        for (std::size_t lane = 0; lane < W; ++lane) {
+            block.index[lane] = FlatPrimitives::no_hit;
+            block.rotation[0][lane] = block.rotation[4][lane] = block.rotation[8][lane] = 1.f;
+            block.extent[0][lane] = block.extent[1][lane] = block.extent[2][lane] = 1.f;
+        }
+        blocks.push_back(block);
+    }
+    PrimitiveBlock& block = blocks.back();
+    std::uint32_t lane = block.count++;
+    block.index[lane] = index;
+    for (int i = 0; i < 3; ++i) {
+        block.position[i][lane] = record.position[i];
+        block.extent[i][lane] = record.extent[i];
+    }
+    for (int i = 0; i < 9; ++i) {
+        block.rotation[i][lane] = record.rotation[i];
+    }
+}
+
+} // namespace
+
+void FlatPrimitives::build(const std::vector<Shape*>& primitives) {
+    records.clear();
+    blocks.clear();
+    std::size_t bounded = 0;
+    complete = true;
+    for (const Shape* primitive : primitives) {
+        records.push_back(make_record(primitive));
+        bounded += primitive->type != PRIMITIVE_TYPE::Plane;
+        complete &= !primitive->motion.has_value() && primitive->type != PRIMITIVE_TYPE::Mesh &&
+                    primitive->type != PRIMITIVE_TYPE::Instance;
+    }
+    if (bounded > max_primitives || !complete) {
+        return;
+    }
+    for (PRIMITIVE_TYPE type : {PRIMITIVE_TYPE::Ellipsoid, PRIMITIVE_TYPE::Box}) {
+        for (std::uint32_t i = 0; i < records.size(); ++i) {
+            if (records[i].type == type) {
+                append(blocks, records[i], i);
+            }
+        }
+    }
+}
+
+bool FlatPrimitives::empty() const {
+    return blocks.empty();
+}
+
+std::pair<float, std::uint32_t> FlatPrimitives::nearest(const PrimitiveBlock& block,
+                                                        glm::vec3 start,
+                                                        glm::vec3 direction) {
+    const float start_xyz[3] = {start.x, start.y, start.z};
+    const float direction_xyz[3] = {direction.x, direction.y, direction.z};
+    float t = 0.f;
+    std::uint32_t index = no_hit;
+    kernels().block_nearest(block, start_xyz, direction_xyz, &t, &index);
+    return {t, index};
+}
+
+} // namespace engine
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "glm/vec3.hpp"
+#include "primitive.hpp"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace engine {
+
+// Transform and extent of one primitive as plain floats, the form the SIMD kernels read.
+struct PrimitiveRecord {
+    PRIMITIVE_TYPE type;
+    float position[3];
+    // Inverse rotation, row-major.
+    float rotation[9];
+    // Normal for planes, inverse radius for ellipsoids, half size for boxes.
+    float extent[3];
+};
+
+// Up to 8 ellipsoids or 8 boxes in SoA layout, so one ray can be tested against all of them with 8-wide kernels.
+struct PrimitiveBlock {
+    static constexpr std::size_t width = 8;
+
+    PRIMITIVE_TYPE type;
+    std::uint32_t count;
+    std::uint32_t index[width];
+    alignas(32) float position[3][width];
+    alignas(32) float rotation[9][width];
+    alignas(32) float extent[3][width];
+};
+
+struct FlatPrimitives {
+    static constexpr std::size_t max_primitives = 32;
+    static constexpr std::uint32_t no_hit = 0xFFFFFFFFu;
+
+    // One record per scene primitive.
+    std::vector<PrimitiveRecord> records;
+    // Every record describes its primitive exactly, which the SIMD kernels need: false when a primitive moves (the
+    // record holds one transform) or is a mesh or an instance (the kernels only know the analytic shapes).
+    bool complete = true;
+    // Flat alternative to the BVH, only built when the scene has at most max_primitives bounded primitives and the
+    // records are complete.
+    std::vector<PrimitiveBlock> blocks;
+
+    void build(const std::vector<Shape*>& primitives);
+    bool empty() const;
+
+    // Nearest intersection distance of the ray with the block and the index of that primitive in the scene,
+    // no_hit when all lanes miss.
+    static std::pair<float, std::uint32_t> nearest(const PrimitiveBlock& block, glm::vec3 start, glm::vec3 direction);
+};
+
+} // namespace engine
@@ -1,89 +1,593 @@
 #include "image.hpp"
+#include "denoise.hpp"
+#include "distributions.hpp"
+#include "kernels.hpp"
+#include "numa.hpp"
+#include "packet.hpp"
 #include "ray.hpp"
+#include "trace.hpp"
 #include "utils.hpp"
+#include "wavefront.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <stdexcept>
+#include <string>
 #include <thread>
 
 namespace engine {
 
-Image generate_image_multithread(const Scene& scene);
+namespace {
 
-Image generate_image(const Scene& scene, bool multithread) {
-    if (multithread) {
-        return generate_image_multithread(scene);
+template <typename T, typename Allocator>
+void allocate(std::vector<T, Allocator>& buffer, bool enabled, std::size_t pixels, T value) {
+    if (enabled) {
+        buffer.assign(pixels, value);
     }
-    
-    Image result{};
-    result.resize(scene.height * scene.width * 3);
-
-    std::uint32_t W = scene.width;
-    std::uint32_t H = scene.height;
-    for (size_t i = 0; i < H; ++i) {
-        for (size_t j = 0; j < W; ++j) {
-            glm::vec3 mean_color{};
-            for (int k = 0; k < scene.samples; ++k) {
-                ray::Ray ray = ray::generate_ray(scene, {j, i});
-                const auto& [_, rawcolor] = ray::raytrace(ray, scene, 0);
-                mean_color += rawcolor;
-            }
-            mean_color /= static_cast<float>(scene.samples);
+    else {
+        std::vector<T, Allocator>().swap(buffer);
+    }
+}
+
+} // namespace
 
-            size_t index = (i * W + j) * 3;
-            result[index] = color_converter(mean_color.r);
-            result[index + 1] = color_converter(mean_color.g);
-            result[index + 2] = color_converter(mean_color.b);
+AOV parse_aov(const std::string& name) {
+    for (AOV aov : all_aovs) {
+        if (name == aov_name(aov)) {
+            return aov;
         }
     }
-    return result;
+    throw std::runtime_error("Unknown AOV: " + name +
+                             " (expected depth, normal, albedo, primitive, material, direct, indirect or samples).");
 }
 
-Image generate_image_multithread(const Scene& scene) {
-    Image result{};
-    result.resize(scene.height * scene.width * 3);
+const char* aov_name(AOV aov) {
+    switch (aov) {
+    case AOV::Depth:
+        return "depth";
+    case AOV::Normal:
+        return "normal";
+    case AOV::Albedo:
+        return "albedo";
+    case AOV::Primitive:
+        return "primitive";
+    case AOV::Material:
+        return "material";
+    case AOV::Direct:
+        return "direct";
+    case AOV::Indirect:
+        return "indirect";
+    case AOV::Samples:
+        return "samples";
+    }
+    return "unknown";
+}
 
-    const std::size_t total_pixels = scene.height * scene.width;
-    const std::size_t threads_num = 4u;
-    std::vector<std::thread> threads;
-    threads.reserve(threads_num);
+void Aovs::enable(AOV aov) {
+    enabled |= 1u << static_cast<std::uint32_t>(aov);
+}
+
+bool Aovs::has(AOV aov) const {
+    return (enabled & (1u << static_cast<std::uint32_t>(aov))) != 0;
+}
+
+void Aovs::resize(std::size_t pixels) {
+    allocate(depth, has(AOV::Depth), pixels, 0.f);
+    allocate(normal, has(AOV::Normal), pixels, glm::vec3{0.f});
+    allocate(albedo, has(AOV::Albedo), pixels, glm::vec3{0.f});
+    allocate(primitive, has(AOV::Primitive), pixels, none);
+    allocate(material, has(AOV::Material), pixels, none);
+    allocate(direct, has(AOV::Direct), pixels, glm::vec3{0.f});
+    allocate(indirect, has(AOV::Indirect), pixels, glm::vec3{0.f});
+    allocate(samples, has(AOV::Samples), pixels, 0u);
+}
+
+void Accumulation::resize(std::size_t pixels) {
+    sum.assign(pixels * 3, 0);
+    count.assign(pixels, 0);
+}
 
-    const std::uint32_t W = scene.width;
-    const std::uint32_t H = scene.height;
+void Accumulation::add(const Accumulation& other) {
+    if (other.sum.size() != sum.size() || other.count.size() != count.size()) {
+        throw std::runtime_error("Accumulations of different sizes cannot be added.");
+    }
+    for (std::size_t i = 0; i < sum.size(); ++i) {
+        sum[i] += other.sum[i];
+    }
+    for (std::size_t i = 0; i < count.size(); ++i) {
+        count[i] += other.count[i];
+    }
+}
+
+glm::vec3 Accumulation::mean(std::size_t pixel) const {
+    if (count[pixel] == 0) {
+        return glm::vec3{0.f};
+    }
+    const double inverse = 1.0 / (scale * count[pixel]);
+    return glm::vec3{static_cast<float>(static_cast<double>(sum[3 * pixel]) * inverse),
+                     static_cast<float>(static_cast<double>(sum[3 * pixel + 1]) * inverse),
+                     static_cast<float>(static_cast<double>(sum[3 * pixel + 2]) * inverse)};
+}
 
-    const std::size_t base_chunk_size = total_pixels / threads_num;
-    std::size_t offset = total_pixels % threads_num;
+bool Region::empty() const {
+    return x1 <= x0 || y1 <= y0;
+}
+
+std::uint32_t Region::width() const {
+    return empty() ? 0 : x1 - x0;
+}
+
+std::uint32_t Region::height() const {
+    return empty() ? 0 : y1 - y0;
+}
+
+std::size_t Region::size() const {
+    return static_cast<std::size_t>(width()) * height();
+}
+
+Region resolve_region(const Scene& scene, const RenderOptions& options) {
+    if (scene.width == 0 || scene.height == 0) {
+        throw std::runtime_error("Scene has no image dimensions.");
+    }
+    const Region& region = options.region;
+    if (region.x0 == 0 && region.y0 == 0 && region.x1 == 0 && region.y1 == 0) {
+        return Region{0, 0, scene.width, scene.height};
+    }
+    if (region.empty() || region.x1 > scene.width || region.y1 > scene.height) {
+        throw std::runtime_error("Render region must be a non-empty part of the image.");
+    }
+    return region;
+}
 
-    auto worker = [&scene, W, &result](std::size_t begin, std::size_t end) {
-        for (size_t i = begin; i < end; ++i) {
-            const size_t row = i / W;
-            const size_t col = i % W;
+namespace {
 
-            glm::vec3 mean_color{};
-            for (int k = 0; k < scene.samples; ++k) {
-                ray::Ray ray = ray::generate_ray(scene, {col, row});
-                const auto& [_, rawcolor] = ray::raytrace(ray, scene, 0);
-                mean_color += rawcolor;
+// Everything a worker needs to render a tile: the options resolved against the scene.
+struct Frame {
+    const Scene& scene;
+    const RenderOptions& options;
+    Region region;
+    std::uint32_t samples;
+    Aovs* aovs;
+};
+
+glm::vec3 render_pixel(const Scene& scene,
+                       std::size_t packet_width,
+                       std::uint32_t samples,
+                       std::size_t row,
+                       std::size_t col) {
+    glm::vec3 mean_color{};
+    std::uint32_t k = 0;
+    if (!scene.flat.complete) {
+        // The packet kernels would test moving primitives and meshes wrongly.
+        packet_width = 0;
+    }
+    if (packet_width == 8) {
+        for (; k + 8 <= samples; k += 8) {
+            mean_color += packet::trace_primary<8>(scene, {col, row});
+        }
+    }
+    else if (packet_width == 4) {
+        for (; k + 4 <= samples; k += 4) {
+            mean_color += packet::trace_primary<4>(scene, {col, row});
+        }
+    }
+    for (; k < samples; ++k) {
+        ray::Ray ray = ray::generate_ray(scene, {col, row});
+        const auto& [_, rawcolor] = ray::raytrace(ray, scene, 0);
+        mean_color += rawcolor;
+    }
+    return mean_color / static_cast<float>(samples);
+}
+
+// Albedo and normal of the first hit or, for mirrors and glass, of the first diffuse surface seen in them (along the
+// refracted ray through glass), tinted by the specular colors on the way: what a denoiser needs to keep reflections
+// and refractions sharp. Traces its rays without drawing random numbers.
+std::pair<glm::vec3, glm::vec3> surface_features(const Scene& scene, ray::Ray ray, ray::Hit hit) {
+    glm::vec3 tint{1.f};
+    for (std::uint32_t depth = 1;; ++depth) {
+        const Shape* shape = hit.primitive;
+        const Intersection& inter = hit.inter;
+        if (shape->material == MATERIAL_TYPE::Diffuse || depth == scene.ray_depth) {
+            return {tint * shape->color, inter.normal};
+        }
+        glm::vec3 direction = ray.direction - 2.f * inter.normal * glm::dot(inter.normal, ray.direction);
+        if (shape->material == MATERIAL_TYPE::Dielectric) {
+            float eta = inter.inside ? shape->ior : 1.f / shape->ior;
+            float cos_theta1 = glm::dot(-ray.direction, inter.normal);
+            float sin_theta2 = eta * std::sqrt(std::max(0.f, 1.f - cos_theta1 * cos_theta1));
+            if (sin_theta2 <= 1.f) {
+                float cos_theta2 = std::sqrt(1.f - sin_theta2 * sin_theta2);
+                direction = eta * ray.direction + (eta * cos_theta1 - cos_theta2) * inter.normal;
+                tint *= inter.inside ? glm::vec3{1.f} : shape->color;
             }
-            mean_color /= static_cast<float>(scene.samples);
+        }
+        else {
+            tint *= shape->color;
+        }
+        ray.start = ray.start + ray.direction * inter.t + direction * 1e-4f;
+        ray.direction = direction;
+        ray::count_traced_rays(1);
+        auto next = ray::closest_intersection(ray, scene);
+        if (!next.has_value()) {
+            return {glm::vec3{0.f}, inter.normal};
+        }
+        hit = next.value();
+    }
+}
+
+// render_pixel that also collects the enabled AOVs into aovs[index]. Draws the same random numbers as raytrace()
+// does for the camera rays, so the radiance is unchanged.
+glm::vec3 render_pixel(const Scene& scene,
+                       std::uint32_t samples,
+                       std::size_t row,
+                       std::size_t col,
+                       Aovs& aovs,
+                       std::size_t index) {
+    const bool surface = aovs.has(AOV::Normal) || aovs.has(AOV::Albedo);
+    const bool split = aovs.has(AOV::Direct) || aovs.has(AOV::Indirect);
+    glm::vec3 color{}, albedo{}, normal{}, direct{};
+    float depth = 0.f;
+    std::int32_t primitive = Aovs::none;
+    std::int32_t material = Aovs::none;
+    ray::Bounce bounce{};
+    if (split) {
+        ray::record_bounce(&bounce);
+    }
+    for (std::uint32_t k = 0; k < samples; ++k) {
+        ray::Ray ray = ray::generate_ray(scene, {col, row});
+        if (scene.ray_depth == 0) {
+            color += scene.bg_color;
+            direct += scene.bg_color;
+            continue;
+        }
+        ray::count_traced_rays(1);
+        auto hit = ray::closest_intersection(ray, scene);
+        if (!hit.has_value()) {
+            color += scene.bg_color;
+            direct += scene.bg_color;
+            continue;
+        }
+        if (k == 0) {
+            primitive = static_cast<std::int32_t>(hit->index);
+            material = static_cast<std::int32_t>(hit->primitive->material);
+        }
+        if (surface) {
+            auto [surface_albedo, surface_normal] = surface_features(scene, ray, hit.value());
+            albedo += surface_albedo;
+            normal += surface_normal;
+        }
+        depth += hit->inter.t;
+        bounce = ray::Bounce{};
+        glm::vec3 sample = ray::calc_color(scene, hit->primitive, ray, hit->inter, 0);
+        color += sample;
+        if (split) {
+            // The sample is emission + throughput * bounce.radiance; keep the part carried by the emission found at
+            // the bounce.
+            glm::vec3 emission = hit->primitive->emission;
+            for (int c = 0; c < 3; ++c) {
+                float share = bounce.radiance[c] > 0.f ? bounce.emission[c] / bounce.radiance[c] : 0.f;
+                direct[c] += emission[c] + (sample[c] - emission[c]) * std::min(share, 1.f);
+            }
+        }
+    }
+    if (split) {
+        ray::record_bounce(nullptr);
+    }
+    const float inverse = 1.f / static_cast<float>(samples);
+    color *= inverse;
+    if (aovs.has(AOV::Depth)) {
+        aovs.depth[index] = depth * inverse;
+    }
+    if (aovs.has(AOV::Normal)) {
+        aovs.normal[index] = normal * inverse;
+    }
+    if (aovs.has(AOV::Albedo)) {
+        aovs.albedo[index] = albedo * inverse;
+    }
+    if (aovs.has(AOV::Primitive)) {
+        aovs.primitive[index] = primitive;
+    }
+    if (aovs.has(AOV::Material)) {
+        aovs.material[index] = material;
+    }
+    if (aovs.has(AOV::Direct)) {
+        aovs.direct[index] = direct * inverse;
+    }
+    if (aovs.has(AOV::Indirect)) {
+        aovs.indirect[index] = color - direct * inverse;
+    }
+    if (aovs.has(AOV::Samples)) {
+        aovs.samples[index] = samples;
+    }
+    return color;
+}
+
+// Samples [first, last) of the accumulation, each seeded on its own, summed in fixed point into it at index.
+glm::vec3 accumulate_pixel(const Frame& frame, std::size_t row, std::size_t col, std::size_t index) {
+    Accumulation& accumulation = *frame.options.accumulation;
+    const std::uint64_t pixel = mix_seed(frame.options.seed.value(), row * frame.scene.width + col);
+    const std::uint32_t first = accumulation.last == 0 ? 0 : accumulation.first;
+    std::int64_t sum[3] = {};
+    for (std::uint32_t k = first; k < first + frame.samples; ++k) {
+        rand::seed(mix_seed(pixel, k));
+        ray::Ray ray = ray::generate_ray(frame.scene, {col, row});
+        const auto& [_, rawcolor] = ray::raytrace(ray, frame.scene, 0);
+        for (int c = 0; c < 3; ++c) {
+            // NaN fails the comparison and counts as zero.
+            const float value = rawcolor[c] > 0.f ? std::min(rawcolor[c], Accumulation::max_sample) : 0.f;
+            sum[c] += std::llround(static_cast<double>(value) * Accumulation::scale);
+        }
+    }
+    for (int c = 0; c < 3; ++c) {
+        accumulation.sum[3 * index + c] = sum[c];
+    }
+    accumulation.count[index] = frame.samples;
+    return accumulation.mean(index);
+}
+
+glm::vec3 render_pixel(const Frame& frame, std::size_t row, std::size_t col, std::size_t index) {
+    if (frame.options.accumulation != nullptr) {
+        return accumulate_pixel(frame, row, col, index);
+    }
+    if (frame.aovs != nullptr) {
+        return render_pixel(frame.scene, frame.samples, row, col, *frame.aovs, index);
+    }
+    return render_pixel(frame.scene, frame.options.packet_width, frame.samples, row, col);
+}
+
+std::uint64_t cost_counter(COST_METRIC metric) {
+    return metric == COST_METRIC::Cycles ? cycle_counter() : ray::traced_rays();
+}
+
+glm::vec3 render_pixel(const Frame& frame, std::size_t index) {
+    const RenderOptions& options = frame.options;
+    std::size_t row = frame.region.y0 + index / frame.region.width();
+    std::size_t col = frame.region.x0 + index % frame.region.width();
+    if (options.seed.has_value() && options.accumulation == nullptr) {
+        rand::seed(mix_seed(options.seed.value(), row * frame.scene.width + col));
+    }
+    if (options.cost_map == nullptr) {
+        return render_pixel(frame, row, col, index);
+    }
+    std::uint64_t begin = cost_counter(options.cost_metric);
+    glm::vec3 color = render_pixel(frame, row, col, index);
+    (*options.cost_map)[index] = cost_counter(options.cost_metric) - begin;
+    return color;
+}
+
+// Seeded wavefront renders draw one random stream per block: the pixels of one image row between two multiples of
+// this many columns of the full image, seeded from the block's first pixel in the full image. Blocks depend on the
+// image alone, and every split of the region across threads keeps them whole, so the image depends neither on the
+// threads nor on the region, as long as its left and right edges fall on block edges.
+constexpr std::size_t wavefront_block = 1024;
+
+// Region index of the first pixel of the block that holds pixel `index` of the region.
+std::size_t block_begin(const Region& region, std::size_t index) {
+    const std::size_t row = index / region.width();
+    const std::size_t col = region.x0 + index % region.width();
+    const std::size_t first = std::max<std::size_t>(region.x0, col / wavefront_block * wavefront_block);
+    return row * region.width() + first - region.x0;
+}
+
+// Region index one past the last pixel of the block that holds pixel `index` of the region.
+std::size_t block_end(const Region& region, std::size_t index) {
+    const std::size_t row = index / region.width();
+    const std::size_t col = region.x0 + index % region.width();
+    const std::size_t last = std::min<std::size_t>(region.x1, (col / wavefront_block + 1) * wavefront_block);
+    return row * region.width() + last - region.x0;
+}
+
+// `index` moved back to the start of its block, or the region size past the end. Splitting the region at such bounds
+// keeps every block in one piece.
+std::size_t split_bound(const Region& region, std::size_t index) {
+    return index >= region.size() ? region.size() : block_begin(region, index);
+}
 
-            const size_t index = i * 3;
-            result[index] = color_converter(mean_color.r);
-            result[index + 1] = color_converter(mean_color.g);
-            result[index + 2] = color_converter(mean_color.b);
+// Pixels [begin, end) of the region, in region order.
+void render_tile(const Frame& frame, std::size_t begin, std::size_t end, glm::vec3* result) {
+    if (frame.options.integrator == INTEGRATOR::Wavefront) {
+        if (!frame.options.seed.has_value()) {
+            wavefront::render(frame.scene, frame.samples, frame.region, begin, end, result);
+            return;
         }
+        const Region& region = frame.region;
+        for (std::size_t block = begin; block < end;) {
+            std::size_t last = std::min(block_end(region, block), end);
+            std::size_t first = (region.y0 + block / region.width()) * frame.scene.width + region.x0 +
+                                block % region.width();
+            rand::seed(mix_seed(frame.options.seed.value(), first));
+            wavefront::render(frame.scene, frame.samples, frame.region, block, last, result);
+            block = last;
+        }
+        return;
+    }
+    for (std::size_t i = begin; i < end; ++i) {
+        result[i] = render_pixel(frame, i);
+    }
+}
+
+// render_tile on the scene replica of the calling thread's NUMA node, if there are replicas. The tile's pages of the
+// result are first written here, which places them on that node too.
+void render_range(const Frame& frame, std::size_t begin, std::size_t end, glm::vec3* result) {
+    const std::vector<const Scene*>* replicas = frame.options.replicas;
+    if (replicas == nullptr || replicas->empty()) {
+        render_tile(frame, begin, end, result);
+        return;
+    }
+    const Scene& local = *(*replicas)[numa::current_node() % replicas->size()];
+    render_tile(Frame{local, frame.options, frame.region, frame.samples, frame.aovs}, begin, end, result);
+}
+
+// Serializes progress and tile callbacks coming from several threads.
+class Progress {
+public:
+    Progress(const RenderOptions& options, std::size_t total)
+        : options(options),
+          total(total),
+          done(0) {}
+
+    void advance(std::size_t begin, std::size_t end) {
+        if (!options.progress && !options.tile_done) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        done += end - begin;
+        if (options.tile_done) {
+            options.tile_done(begin, end);
+        }
+        if (options.progress) {
+            options.progress(done, total);
+        }
+    }
+
+private:
+    const RenderOptions& options;
+    std::size_t total;
+    std::size_t done;
+    std::mutex mutex;
+};
+
+constexpr std::size_t tile_size = 1024;
+
+void render_single(const Frame& frame, glm::vec3* result) {
+    trace::Span span("render");
+    const std::size_t total = frame.region.size();
+    Progress progress(frame.options, total);
+    for (std::size_t begin = 0; begin < total;) {
+        std::size_t end = split_bound(frame.region, begin + tile_size);
+        render_range(frame, begin, end, result);
+        progress.advance(begin, end);
+        begin = end;
+    }
+}
+
+void render_multithread(const Frame& frame, glm::vec3* result) {
+    const std::size_t total_pixels = frame.region.size();
+    const std::size_t threads_num = 4u;
+    std::vector<std::thread> threads;
+    threads.reserve(threads_num);
+    Progress progress(frame.options, total_pixels);
+
+    const std::vector<int> cpus = frame.options.pin_threads ? numa::spread_cpus(threads_num) : std::vector<int>{};
+
+    auto worker = [&frame, &progress, &cpus, result](std::size_t thread, std::size_t begin, std::size_t end) {
+        if (!cpus.empty()) {
+            numa::pin_thread({cpus[thread]});
+        }
+        trace::Span span("chunk [" + std::to_string(begin) + ", " + std::to_string(end) + ")");
+        render_range(frame, begin, end, result);
+        progress.advance(begin, end);
     };
 
+    // Chunks end on wavefront block boundaries, so no block is split between threads.
     std::size_t start = 0;
     for (std::size_t i = 0; i < threads_num; ++i) {
-        const std::size_t chunk_size = base_chunk_size + (i < offset ? 1 : 0);
-        threads.emplace_back(worker, start, start + chunk_size);
-        start += chunk_size;
+        const std::size_t end = split_bound(frame.region, total_pixels * (i + 1) / threads_num);
+        threads.emplace_back(worker, i, start, end);
+        start = end;
     }
 
     for (auto& t : threads) {
         t.join();
     }
+}
+
+void render_pool(const Frame& frame, glm::vec3* result) {
+    trace::Span span("render");
+    const std::size_t total = frame.region.size();
+    Progress progress(frame.options, total);
+
+    const std::size_t tiles = (total + tile_size - 1) / tile_size;
+    frame.options.pool->parallel_for(tiles, [&](std::size_t tile) {
+        std::size_t begin = split_bound(frame.region, tile * tile_size);
+        std::size_t end = split_bound(frame.region, (tile + 1) * tile_size);
+        trace::Span span("tile [" + std::to_string(begin) + ", " + std::to_string(end) + ")");
+        render_range(frame, begin, end, result);
+        progress.advance(begin, end);
+    });
+}
 
+} // namespace
+
+void render(const Scene& scene, const RenderOptions& options, glm::vec3* result) {
+    if (options.cost_map != nullptr && options.integrator != INTEGRATOR::Recursive) {
+        throw std::runtime_error("Cost map is only supported by the recursive integrator.");
+    }
+    if ((options.aovs != nullptr || options.denoise) && options.integrator != INTEGRATOR::Recursive) {
+        throw std::runtime_error("AOVs and denoising are only supported by the recursive integrator.");
+    }
+    if (options.packet_width != 0 && options.packet_width != 4 && options.packet_width != 8) {
+        throw std::runtime_error("Packet width must be 4 or 8.");
+    }
+    if (options.accumulation != nullptr) {
+        if (options.integrator != INTEGRATOR::Recursive || options.packet_width != 0 || options.aovs != nullptr ||
+            options.denoise) {
+            throw std::runtime_error("Sample accumulation needs the recursive integrator without packets, AOVs or "
+                                     "denoising.");
+        }
+        if (!options.seed.has_value()) {
+            throw std::runtime_error("Sample accumulation needs a seed.");
+        }
+        if (options.accumulation->last < options.accumulation->first) {
+            throw std::runtime_error("Sample range must not end before it starts.");
+        }
+    }
+    Aovs features;
+    Frame frame{scene,
+                options,
+                resolve_region(scene, options),
+                options.samples != 0 ? options.samples : scene.samples,
+                options.aovs != nullptr ? options.aovs : (options.denoise ? &features : nullptr)};
+    if (options.accumulation != nullptr) {
+        if (options.accumulation->last != 0) {
+            frame.samples = options.accumulation->last - options.accumulation->first;
+        }
+        options.accumulation->resize(frame.region.size());
+    }
+    if (options.cost_map != nullptr) {
+        options.cost_map->assign(frame.region.size(), 0);
+    }
+    if (options.denoise) {
+        for (AOV guide : {AOV::Depth, AOV::Normal, AOV::Albedo}) {
+            frame.aovs->enable(guide);
+        }
+    }
+    if (frame.aovs != nullptr) {
+        frame.aovs->resize(frame.region.size());
+    }
+    if (options.pool != nullptr) {
+        render_pool(frame, result);
+    }
+    else if (options.multithread) {
+        render_multithread(frame, result);
+    }
+    else {
+        render_single(frame, result);
+    }
+    if (options.denoise) {
+        denoise(result, *frame.aovs, frame.region.width(), frame.region.height(), options.pool);
+    }
+}
+
+HdrImage render(const Scene& scene, const RenderOptions& options) {
+    HdrImage result(resolve_region(scene, options).size());
+    render(scene, options, result.data());
     return result;
 }
 
+Image post_process(const HdrImage& hdr) {
+    trace::Span span("post_process");
+
+    static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "HdrImage must be packed RGB floats");
+    Image result{};
+    result.resize(hdr.size() * 3);
+    kernels().tone_map(&hdr.data()->x, hdr.size(), result.data());
+    return result;
+}
+
+Image generate_image(const Scene& scene, const RenderOptions& options) {
+    return post_process(render(scene, options));
+}
+
 } // namespace engine
@@ -1,13 +1,176 @@
 #pragma once
 
 #include "scene.hpp"
+#include "thread_pool.hpp"
 
 #include <cstdint>
+#include <functional>
+#include <optional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace engine {
 
+// std::allocator that default-initializes the elements a container creates without a value, like
+// make_unique_for_overwrite: trivial types are left uninitialized.
+template <typename T>
+struct OverwriteAllocator : std::allocator<T> {
+    OverwriteAllocator() = default;
+    template <typename U>
+    OverwriteAllocator(const OverwriteAllocator<U>&) noexcept {}
+
+    template <typename U>
+    void construct(U* p) noexcept(std::is_nothrow_default_constructible_v<U>) {
+        ::new (static_cast<void*>(p)) U;
+    }
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args) {
+        ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
+};
+
 using Image = std::vector<std::uint8_t>;
-Image generate_image(const Scene& scene, bool multithread);
+// HdrImage(n) and resize(n) leave the pixels uninitialized, so every page of a radiance buffer is first touched, and
+// placed, by the worker that renders into it. Pass a value where the pixels must start at zero.
+using HdrImage = std::vector<glm::vec3, OverwriteAllocator<glm::vec3>>;
+using CostMap = std::vector<std::uint64_t>;
+
+enum class COST_METRIC { Cycles, Rays };
+enum class INTEGRATOR { Recursive, Wavefront };
+
+// Arbitrary output variables: per-pixel passes collected next to the radiance.
+enum class AOV { Depth, Normal, Albedo, Primitive, Material, Direct, Indirect, Samples };
+inline constexpr AOV all_aovs[] = {AOV::Depth,    AOV::Normal, AOV::Albedo,   AOV::Primitive,
+                                   AOV::Material, AOV::Direct, AOV::Indirect, AOV::Samples};
+
+// "depth" -> AOV::Depth; throws on unknown names.
+AOV parse_aov(const std::string& name);
+const char* aov_name(AOV aov);
+
+// The enabled AOVs of a region, laid out like the radiance. Averaged over the samples of each pixel unless noted;
+// samples that miss everything count as zero.
+struct Aovs {
+    static constexpr std::int32_t none = -1;
+
+    // One bit per AOV value; only enabled AOVs are allocated and collected.
+    std::uint32_t enabled = 0;
+
+    // Intersection::t of the camera ray.
+    std::vector<float> depth;
+    // Surface normal at the first hit, or at the first diffuse surface seen in mirrors and glass.
+    HdrImage normal;
+    // Shape::color at the first hit. Mirrors and glass are looked through: their color tints the albedo of the first
+    // diffuse surface seen in them (along the refracted ray for glass), or zero if that is the background.
+    HdrImage albedo;
+    // Scene primitive (the instance for instanced primitives) and MATERIAL_TYPE hit by the pixel's first camera ray,
+    // `none` on a miss.
+    std::vector<std::int32_t> primitive;
+    std::vector<std::int32_t> material;
+    // Radiance split by path length: emission at the first hit plus light arriving there straight from an emitter or
+    // the background, and everything that bounced more than once. Direct + indirect is the pixel's radiance.
+    HdrImage direct;
+    HdrImage indirect;
+    // Camera samples that went into the pixel.
+    std::vector<std::uint32_t> samples;
+
+    void enable(AOV aov);
+    bool has(AOV aov) const;
+    // Sizes the enabled buffers for `pixels` pixels and releases the others.
+    void resize(std::size_t pixels);
+};
+
+// Radiance summed over a slice of every pixel's samples, in fixed point: integer sums do not depend on the order they
+// are added in, so slices of the sample range rendered by different threads or processes add up to exactly the sums a
+// render of the whole range gets.
+struct Accumulation {
+    // Fixed point units per unit of radiance. Samples are clamped to [0, max_sample], which keeps 2^19 samples of a
+    // pixel from overflowing.
+    static constexpr double scale = 16777216.0;
+    static constexpr float max_sample = 1048576.f;
+
+    // Sample indices [first, last) of every pixel to render; both zero renders all the samples.
+    std::uint32_t first = 0;
+    std::uint32_t last = 0;
+    // 3 sums per pixel, in fixed point.
+    std::vector<std::int64_t> sum;
+    std::vector<std::uint32_t> count;
+
+    void resize(std::size_t pixels);
+    // Adds the sums and counts of another accumulation of the same pixels; throws on a different size.
+    void add(const Accumulation& other);
+    // Mean radiance of the pixel; zero without samples.
+    glm::vec3 mean(std::size_t pixel) const;
+};
+
+// Pixels [x0, x1) x [y0, y1) of the image. The default, all zero, stands for the whole image.
+struct Region {
+    std::uint32_t x0 = 0;
+    std::uint32_t y0 = 0;
+    std::uint32_t x1 = 0;
+    std::uint32_t y1 = 0;
+
+    bool empty() const;
+    std::uint32_t width() const;
+    std::uint32_t height() const;
+    std::size_t size() const;
+};
+
+struct RenderOptions {
+    bool multithread = false;
+    // Pins the threads of a multithread render to one CPU each, spread evenly over the NUMA nodes.
+    bool pin_threads = false;
+    INTEGRATOR integrator = INTEGRATOR::Recursive;
+    // Trace camera samples of a pixel in packets of 4 or 8 rays; 0 traces them one by one. Recursive integrator only.
+    std::size_t packet_width = 0;
+    // When set, receives the per-pixel render cost of the region measured in cost_metric units. Recursive integrator
+    // only.
+    CostMap* cost_map = nullptr;
+    COST_METRIC cost_metric = COST_METRIC::Cycles;
+    // When set, receives the AOVs enabled in it for the region, collected in the same pass as the radiance. Camera
+    // rays are then traced one by one (no packets). Null costs nothing. Recursive integrator only.
+    Aovs* aovs = nullptr;
+    // Runs the À-Trous denoiser (denoise.hpp) over the radiance once the region is rendered, guided by the depth,
+    // normal and albedo AOVs, which are added to aovs (or collected internally if aovs is not set). tile_done and
+    // progress report the values before filtering. Recursive integrator only.
+    bool denoise = false;
+    // When set, every sample draws from its own random stream, derived from the seed, its pixel and its index, and only
+    // samples [first, last) of accumulation are rendered and summed into it; the result receives their mean. A seed
+    // is required. Recursive integrator only, without packets, AOVs or denoising.
+    Accumulation* accumulation = nullptr;
+    // Copies of the scene, one per NUMA node (indexed like numa::topology().nodes): each thread reads the copy of the
+    // node it runs on instead of the scene. Must describe the same scene. Empty or null uses the scene everywhere.
+    const std::vector<const Scene*>* replicas = nullptr;
+    // When set, tiles of the image are rendered on this pool instead of threads started for the render.
+    ThreadPool* pool = nullptr;
+    // Samples per pixel; 0 keeps the SAMPLES of the scene.
+    std::uint32_t samples = 0;
+    // With a seed every pixel draws its random numbers from a stream derived from the seed and its position, so the
+    // image does not depend on thread count or scheduling. The wavefront integrator draws one stream per run of up to
+    // 1024 pixels of a row, cut at multiples of 1024 columns of the full image, so a region matches the same pixels of
+    // the full image only if its left and right edges fall on such cuts or on the image edges. Without a seed the
+    // streams are seeded from random_device.
+    std::optional<std::uint64_t> seed;
+    // Part of the image to render; results are laid out row by row over the region only.
+    Region region;
+    // Called after every finished tile with the number of pixels done so far and the total. Calls may come from
+    // worker threads but never overlap.
+    std::function<void(std::size_t done, std::size_t total)> progress;
+    // Called after every finished tile with its pixels [begin, end) in region order, once their values are in the
+    // result buffer. Serialized with progress.
+    std::function<void(std::size_t begin, std::size_t end)> tile_done;
+};
+
+// The region the options select in the scene: the whole image when options.region is empty. Throws if the region
+// does not fit in the image.
+Region resolve_region(const Scene& scene, const RenderOptions& options);
+
+// Renders the region into result, which must hold resolve_region(...).size() values.
+void render(const Scene& scene, const RenderOptions& options, glm::vec3* result);
+HdrImage render(const Scene& scene, const RenderOptions& options);
+Image generate_image(const Scene& scene, const RenderOptions& options);
+Image post_process(const HdrImage& hdr);
 
 } // namespace engine
@@ -0,0 +1,27 @@
+#include "instance.hpp"
+
+#include <stdexcept>
+
+namespace engine {
+
+ObjectData::~ObjectData() {
+    for (Shape* primitive : primitives) {
+        delete primitive;
+    }
+}
+
+void ObjectData::prepare() {
+    if (primitives.empty()) {
+        throw std::runtime_error("Object has no primitives.");
+    }
+    bounds = Aabb{};
+    for (const Shape* primitive : primitives) {
+        if (primitive->type == PRIMITIVE_TYPE::Plane) {
+            throw std::runtime_error("Objects cannot contain planes.");
+        }
+        bounds.extend(shape_bounds(primitive));
+    }
+    bvh.build(primitives);
+}
+
+} // namespace engine
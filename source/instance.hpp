@@ -0,0 +1,27 @@
+#pragma once
+
+#include "bvh.hpp"
+#include "primitive.hpp"
+
+#include <vector>
+
+namespace engine {
+
+// Primitives defined once in their own object space (NEW_OBJECT ... END_OBJECT) and shared by every INSTANCE of
+// them: an instance only adds a transform, so memory grows with the unique geometry rather than the instance count.
+struct ObjectData {
+    ObjectData() = default;
+    ObjectData(const ObjectData&) = delete;
+    ObjectData& operator=(const ObjectData&) = delete;
+    ~ObjectData();
+
+    std::vector<Shape*> primitives;
+    // Bottom-level BVH over `primitives`; the scene BVH over the instances is the top level.
+    Bvh bvh;
+    Aabb bounds;
+
+    // Builds the BVH and bounds. Planes are rejected: an instance needs finite bounds.
+    void prepare();
+};
+
+} // namespace engine
@@ -1,22 +1,344 @@
 #include "io.hpp"
 #include "glm/geometric.hpp"
+#include "instance.hpp"
+#include "mesh.hpp"
 #include "primitive.hpp"
 
+#include <algorithm>
+#include <array>
 #include <fstream>
+#include <memory>
 #include <ios>
 #include <ostream>
 #include <sstream>
 #include <stdexcept>
+#include <unordered_map>
 
 namespace engine::io {
 
-Scene load_scene(const std::string& path) {
-    std::ifstream in(path);
-    if (!in.is_open()) {
-        throw std::runtime_error("Bad path to scene file.");
+namespace {
+
+constexpr char binary_magic[4] = {'R', 'T', 'S', 'B'};
+constexpr std::uint32_t binary_version = 5;
+
+template <typename T>
+void write_value(std::ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void write_vec3(std::ostream& out, const glm::vec3& value) {
+    write_value(out, value.x);
+    write_value(out, value.y);
+    write_value(out, value.z);
+}
+
+template <typename T>
+T read_value(std::istream& in) {
+    T value{};
+    if (!in.read(reinterpret_cast<char*>(&value), sizeof(T))) {
+        throw std::runtime_error("Binary scene is truncated.");
+    }
+    return value;
+}
+
+glm::vec3 read_vec3(std::istream& in) {
+    glm::vec3 value;
+    value.x = read_value<float>(in);
+    value.y = read_value<float>(in);
+    value.z = read_value<float>(in);
+    return value;
+}
+
+void write_quat(std::ostream& out, const glm::quat& value) {
+    write_value(out, value.x);
+    write_value(out, value.y);
+    write_value(out, value.z);
+    write_value(out, value.w);
+}
+
+glm::quat read_quat(std::istream& in) {
+    glm::quat value;
+    value.x = read_value<float>(in);
+    value.y = read_value<float>(in);
+    value.z = read_value<float>(in);
+    value.w = read_value<float>(in);
+    return value;
+}
+
+template <typename T, typename Write>
+void write_track(std::ostream& out, const Track<T>& track, Write write) {
+    write_value(out, static_cast<std::uint32_t>(track.keys.size()));
+    for (const auto& [time, value] : track.keys) {
+        write_value(out, time);
+        write(out, value);
+    }
+}
+
+template <typename T, typename Read>
+void read_track(std::istream& in, Track<T>& track, Read read) {
+    std::uint32_t count = read_value<std::uint32_t>(in);
+    for (std::uint32_t i = 0; i < count; ++i) {
+        float time = read_value<float>(in);
+        track.add(time, read(in));
+    }
+}
+
+void write_animation(std::ostream& out, const Animation& animation) {
+    write_value(out, animation.frames);
+    write_value(out, animation.shutter);
+    write_track(out, animation.camera_position, write_vec3);
+    write_track(out, animation.camera_forward, write_vec3);
+    write_track(out, animation.camera_up, write_vec3);
+    write_value(out, static_cast<std::uint32_t>(animation.primitives.size()));
+    for (const PrimitiveAnimation& primitive : animation.primitives) {
+        write_value(out, primitive.primitive);
+        write_track(out, primitive.position, write_vec3);
+        write_track(out, primitive.rotation, write_quat);
+    }
+}
+
+void read_animation(std::istream& in, Scene& scene, std::uint32_t version) {
+    Animation& animation = scene.animation;
+    animation.frames = read_value<std::uint32_t>(in);
+    if (version >= 3) {
+        animation.shutter = read_value<float>(in);
+    }
+    read_track(in, animation.camera_position, read_vec3);
+    read_track(in, animation.camera_forward, read_vec3);
+    read_track(in, animation.camera_up, read_vec3);
+    std::uint32_t count = read_value<std::uint32_t>(in);
+    for (std::uint32_t i = 0; i < count; ++i) {
+        std::uint32_t index = read_value<std::uint32_t>(in);
+        if (index >= scene.primitives.size()) {
+            throw std::runtime_error("Animated primitive out of range in binary scene.");
+        }
+        PrimitiveAnimation& primitive = animation.primitive(index);
+        read_track(in, primitive.position, read_vec3);
+        read_track(in, primitive.rotation, read_quat);
+    }
+}
+
+std::shared_ptr<MeshData> read_mesh(std::istream& in) {
+    auto mesh = std::make_shared<MeshData>();
+    mesh->vertices.resize(read_value<std::uint32_t>(in));
+    for (glm::vec3& vertex : mesh->vertices) {
+        vertex = read_vec3(in);
+    }
+    mesh->indices.resize(read_value<std::uint32_t>(in));
+    for (std::uint32_t& index : mesh->indices) {
+        index = read_value<std::uint32_t>(in);
+        if (index >= mesh->vertices.size()) {
+            throw std::runtime_error("Mesh face refers to a missing vertex.");
+        }
+    }
+    mesh->prepare();
+    return mesh;
+}
+
+void write_mesh(std::ostream& out, const MeshData& mesh) {
+    write_value(out, static_cast<std::uint32_t>(mesh.vertices.size()));
+    for (const glm::vec3& vertex : mesh.vertices) {
+        write_vec3(out, vertex);
+    }
+    write_value(out, static_cast<std::uint32_t>(mesh.indices.size()));
+    for (std::uint32_t index : mesh.indices) {
+        write_value(out, index);
+    }
+}
+
+// Shared geometry is stored once, ahead of the primitives, which refer to it by index.
+struct BinaryReader {
+    std::istream& in;
+    std::uint32_t version;
+    std::vector<std::shared_ptr<MeshData>> meshes;
+    std::vector<std::shared_ptr<ObjectData>> objects;
+
+    template <typename T>
+    const std::shared_ptr<T>& shared(const std::vector<std::shared_ptr<T>>& table) {
+        std::uint32_t index = read_value<std::uint32_t>(in);
+        if (index >= table.size()) {
+            throw std::runtime_error("Shared geometry out of range in binary scene.");
+        }
+        return table[index];
+    }
+
+    std::unique_ptr<Shape> read_primitive() {
+        auto type = static_cast<PRIMITIVE_TYPE>(read_value<std::uint32_t>(in));
+        glm::vec3 shape = read_vec3(in);
+        std::unique_ptr<Shape> primitive;
+        switch (type) {
+        case PRIMITIVE_TYPE::Plane: {
+            auto plane = std::make_unique<Plane>();
+            plane->normal = shape;
+            primitive = std::move(plane);
+            break;
+        }
+        case PRIMITIVE_TYPE::Ellipsoid: {
+            auto ellipsoid = std::make_unique<Ellipsoid>();
+            ellipsoid->radius = shape;
+            primitive = std::move(ellipsoid);
+            break;
+        }
+        case PRIMITIVE_TYPE::Box: {
+            auto box = std::make_unique<Box>();
+            box->size = shape;
+            primitive = std::move(box);
+            break;
+        }
+        case PRIMITIVE_TYPE::Mesh: {
+            auto mesh = std::make_unique<Mesh>();
+            mesh->data = shared(meshes);
+            primitive = std::move(mesh);
+            break;
+        }
+        case PRIMITIVE_TYPE::Instance: {
+            auto instance = std::make_unique<Instance>();
+            instance->object = shared(objects);
+            primitive = std::move(instance);
+            break;
+        }
+        default:
+            throw std::runtime_error("Unknown primitive type in binary scene.");
+        }
+        primitive->material = static_cast<MATERIAL_TYPE>(read_value<std::uint32_t>(in));
+        primitive->position = read_vec3(in);
+        primitive->rotation = read_quat(in);
+        primitive->color = read_vec3(in);
+        primitive->emission = read_vec3(in);
+        primitive->ior = read_value<float>(in);
+        if (version >= 3 && read_value<std::uint32_t>(in) != 0) {
+            Motion motion;
+            motion.translation = read_vec3(in);
+            motion.rotation = read_quat(in);
+            primitive->motion = motion;
+        }
+        return primitive;
+    }
+};
+
+struct BinaryWriter {
+    std::ostream& out;
+    std::vector<const MeshData*> meshes;
+    // Nested objects come before the objects that instance them.
+    std::vector<const ObjectData*> objects;
+
+    template <typename T>
+    static std::uint32_t find(const std::vector<const T*>& table, const T* item) {
+        return static_cast<std::uint32_t>(std::find(table.begin(), table.end(), item) - table.begin());
+    }
+
+    void collect(const std::vector<Shape*>& primitives) {
+        for (const Shape* primitive : primitives) {
+            if (primitive->type == PRIMITIVE_TYPE::Mesh) {
+                const MeshData* mesh = dynamic_cast<const Mesh*>(primitive)->data.get();
+                if (find(meshes, mesh) == meshes.size()) {
+                    meshes.push_back(mesh);
+                }
+            }
+            else if (primitive->type == PRIMITIVE_TYPE::Instance) {
+                const ObjectData* object = dynamic_cast<const Instance*>(primitive)->object.get();
+                if (find(objects, object) == objects.size()) {
+                    collect(object->primitives);
+                    objects.push_back(object);
+                }
+            }
+        }
+    }
+
+    void write_primitive(const Shape* primitive) {
+        write_value(out, static_cast<std::uint32_t>(primitive->type));
+        switch (primitive->type) {
+        case PRIMITIVE_TYPE::Plane:
+            write_vec3(out, dynamic_cast<const Plane*>(primitive)->normal);
+            break;
+        case PRIMITIVE_TYPE::Ellipsoid:
+            write_vec3(out, dynamic_cast<const Ellipsoid*>(primitive)->radius);
+            break;
+        case PRIMITIVE_TYPE::Box:
+            write_vec3(out, dynamic_cast<const Box*>(primitive)->size);
+            break;
+        case PRIMITIVE_TYPE::Mesh:
+            write_vec3(out, glm::vec3{0.f, 0.f, 0.f});
+            write_value(out, find(meshes, dynamic_cast<const Mesh*>(primitive)->data.get()));
+            break;
+        case PRIMITIVE_TYPE::Instance:
+            write_vec3(out, glm::vec3{0.f, 0.f, 0.f});
+            write_value(out, find(objects, dynamic_cast<const Instance*>(primitive)->object.get()));
+            break;
+        }
+        write_value(out, static_cast<std::uint32_t>(primitive->material));
+        write_vec3(out, primitive->position);
+        write_quat(out, primitive->rotation);
+        write_vec3(out, primitive->color);
+        write_vec3(out, primitive->emission);
+        write_value(out, primitive->ior);
+        write_value(out, static_cast<std::uint32_t>(primitive->motion.has_value()));
+        if (primitive->motion.has_value()) {
+            write_vec3(out, primitive->motion->translation);
+            write_quat(out, primitive->motion->rotation);
+        }
+    }
+};
+
+Scene parse_binary_scene(std::istream& in) {
+    char magic[4];
+    in.read(magic, sizeof(magic));
+    const auto version = read_value<std::uint32_t>(in);
+    if (version == 0 || version > binary_version) {
+        throw std::runtime_error("Unsupported binary scene version.");
     }
+    Scene scene;
+    scene.width = read_value<std::uint32_t>(in);
+    scene.height = read_value<std::uint32_t>(in);
+    scene.bg_color = read_vec3(in);
+    scene.camera.camera_fov_x = read_value<float>(in);
+    scene.camera.camera_position = read_vec3(in);
+    scene.camera.camera_right = read_vec3(in);
+    scene.camera.camera_up = read_vec3(in);
+    scene.camera.camera_forward = read_vec3(in);
+    scene.ray_depth = read_value<std::uint32_t>(in);
+    scene.samples = read_value<std::uint32_t>(in);
+
+    BinaryReader reader{in, version, {}, {}};
+    if (version >= 4) {
+        reader.meshes.resize(read_value<std::uint32_t>(in));
+        for (std::shared_ptr<MeshData>& mesh : reader.meshes) {
+            mesh = read_mesh(in);
+        }
+    }
+    if (version >= 5) {
+        std::uint32_t objects = read_value<std::uint32_t>(in);
+        for (std::uint32_t i = 0; i < objects; ++i) {
+            auto object = std::make_shared<ObjectData>();
+            std::uint32_t count = read_value<std::uint32_t>(in);
+            for (std::uint32_t k = 0; k < count; ++k) {
+                object->primitives.push_back(reader.read_primitive().release());
+            }
+            object->prepare();
+            reader.objects.push_back(object);
+        }
+    }
+
+    std::uint32_t count = read_value<std::uint32_t>(in);
+    for (std::uint32_t i = 0; i < count; ++i) {
+        scene.primitives.push_back(reader.read_primitive().release());
+    }
+    if (version >= 2) {
+        read_animation(in, scene, version);
+    }
+    return scene;
+}
+
+Scene parse_text_scene(std::istream& in, const std::string& directory) {
     Scene scene;
     std::string line;
+    // Meshes loaded so far by path: primitives made from the same file share its data.
+    std::unordered_map<std::string, std::shared_ptr<MeshData>> meshes;
+    std::unordered_map<std::string, std::shared_ptr<ObjectData>> objects;
+    // Object being defined between NEW_OBJECT and END_OBJECT; its primitives go there instead of into the scene.
+    std::shared_ptr<ObjectData> object;
+    std::string object_name;
+    std::vector<Shape*>* target = &scene.primitives;
 
     while (std::getline(in, line)) {
         std::stringstream ss(line);
@@ -61,49 +383,203 @@ Scene load_scene(const std::string& path) {
                 Plane* new_plane = new Plane();
                 ss >> new_plane->normal.x >> new_plane->normal.y >> new_plane->normal.z;
                 new_plane->normal = glm::normalize(new_plane->normal);
-                scene.primitives.push_back(new_plane);
+                target->push_back(new_plane);
             }
             else if (command == "ELLIPSOID") {
                 Ellipsoid* new_ellipsoid = new Ellipsoid();
                 ss >> new_ellipsoid->radius.x >> new_ellipsoid->radius.y >> new_ellipsoid->radius.z;
-                scene.primitives.push_back(new_ellipsoid);
+                target->push_back(new_ellipsoid);
             }
             else if (command == "BOX") {
                 Box* new_box = new Box();
                 ss >> new_box->size.x >> new_box->size.y >> new_box->size.z;
-                scene.primitives.push_back(new_box);
+                target->push_back(new_box);
+            }
+            else if (command == "INSTANCE") {
+                std::string name;
+                ss >> name;
+                auto it = objects.find(name);
+                if (it == objects.end()) {
+                    throw std::runtime_error("Instance of unknown object " + name + ".");
+                }
+                Instance* new_instance = new Instance();
+                new_instance->object = it->second;
+                target->push_back(new_instance);
+            }
+            else if (command == "MESH") {
+                std::string path;
+                ss >> path;
+                if (!directory.empty() && !path.empty() && path[0] != '/') {
+                    path = directory + '/' + path;
+                }
+                std::shared_ptr<MeshData>& data = meshes[path];
+                if (data == nullptr) {
+                    data = load_mesh(path);
+                }
+                Mesh* new_mesh = new Mesh();
+                new_mesh->data = data;
+                target->push_back(new_mesh);
+            }
+        }
+        else if (command == "NEW_OBJECT") {
+            if (object != nullptr) {
+                throw std::runtime_error("Objects cannot be nested in their definition; instance them instead.");
+            }
+            object = std::make_shared<ObjectData>();
+            ss >> object_name;
+            target = &object->primitives;
+        }
+        else if (command == "END_OBJECT") {
+            if (object == nullptr) {
+                throw std::runtime_error("END_OBJECT without NEW_OBJECT.");
             }
+            object->prepare();
+            objects[object_name] = std::move(object);
+            object = nullptr;
+            target = &scene.primitives;
         }
         else if (command == "POSITION") {
-            auto primitive = scene.primitives.back();
+            auto primitive = target->back();
             ss >> primitive->position.x >> primitive->position.y >> primitive->position.z;
         }
         else if (command == "ROTATION") {
-            auto primitive = scene.primitives.back();
+            auto primitive = target->back();
             ss >> primitive->rotation.x >> primitive->rotation.y >> primitive->rotation.z >> primitive->rotation.w;
         }
         else if (command == "COLOR") {
-            auto primitive = scene.primitives.back();
+            auto primitive = target->back();
             ss >> primitive->color.x >> primitive->color.y >> primitive->color.z;
         }
         else if (command == "METALLIC") {
-            scene.primitives.back()->material = MATERIAL_TYPE::Metallic;
+            target->back()->material = MATERIAL_TYPE::Metallic;
         }
         else if (command == "DIELECTRIC") {
-            scene.primitives.back()->material = MATERIAL_TYPE::Dielectric;
+            target->back()->material = MATERIAL_TYPE::Dielectric;
         }
         else if (command == "EMISSION") {
-            auto primitive = scene.primitives.back();
+            auto primitive = target->back();
             ss >> primitive->emission.r >> primitive->emission.g >> primitive->emission.b;
         }
         else if (command == "IOR") {
-            ss >> scene.primitives.back()->ior;
+            ss >> target->back()->ior;
+        }
+        else if (command == "MOTION") {
+            auto primitive = target->back();
+            Motion motion = primitive->motion.value_or(Motion{});
+            ss >> motion.translation.x >> motion.translation.y >> motion.translation.z;
+            primitive->motion = motion;
+        }
+        else if (command == "MOTION_ROTATION") {
+            auto primitive = target->back();
+            Motion motion = primitive->motion.value_or(Motion{});
+            ss >> motion.rotation.x >> motion.rotation.y >> motion.rotation.z >> motion.rotation.w;
+            motion.rotation = glm::normalize(motion.rotation);
+            primitive->motion = motion;
+        }
+        else if (command == "SHUTTER") {
+            ss >> scene.animation.shutter;
+        }
+        else if (command == "FRAMES") {
+            ss >> scene.animation.frames;
+        }
+        else if (command == "KEY_CAMERA_POSITION" || command == "KEY_CAMERA_FORWARD" || command == "KEY_CAMERA_UP") {
+            float time;
+            glm::vec3 value;
+            ss >> time >> value.x >> value.y >> value.z;
+            Track<glm::vec3>& track = command == "KEY_CAMERA_POSITION" ? scene.animation.camera_position
+                                      : command == "KEY_CAMERA_FORWARD" ? scene.animation.camera_forward
+                                                                        : scene.animation.camera_up;
+            track.add(time, value);
         }
+        else if ((command == "KEY_POSITION" || command == "KEY_ROTATION") && object != nullptr) {
+            throw std::runtime_error("Primitives inside objects cannot be keyframed; keyframe the instance.");
+        }
+        else if (command == "KEY_POSITION") {
+            float time;
+            glm::vec3 position;
+            ss >> time >> position.x >> position.y >> position.z;
+            auto index = static_cast<std::uint32_t>(scene.primitives.size() - 1);
+            scene.animation.primitive(index).position.add(time, position);
+        }
+        else if (command == "KEY_ROTATION") {
+            float time;
+            glm::quat rotation;
+            ss >> time >> rotation.x >> rotation.y >> rotation.z >> rotation.w;
+            auto index = static_cast<std::uint32_t>(scene.primitives.size() - 1);
+            scene.animation.primitive(index).rotation.add(time, rotation);
+        }
+    }
+    if (object != nullptr) {
+        throw std::runtime_error("NEW_OBJECT without END_OBJECT.");
+    }
+    return scene;
+}
+
+} // namespace
+
+Scene parse_scene(std::istream& in,
+                  LIGHT_SAMPLING light_sampling,
+                  const std::string& directory,
+                  const std::string& bvh_cache) {
+    char magic[4] = {};
+    in.read(magic, sizeof(magic));
+    const bool binary = in.gcount() == sizeof(magic) && std::equal(magic, magic + 4, binary_magic);
+    in.clear();
+    in.seekg(0);
+    Scene scene = binary ? parse_binary_scene(in) : parse_text_scene(in, directory);
+    scene.light_sampling = light_sampling;
+    if (!scene.animation.empty()) {
+        scene.animation.apply(scene, 0.f);
     }
     scene.init_light_distrs();
+    scene.init_bvh(bvh_cache);
     return scene;
 }
 
+Scene load_scene(const std::string& path, LIGHT_SAMPLING light_sampling, const std::string& bvh_cache) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        throw std::runtime_error("Bad path to scene file.");
+    }
+    std::size_t slash = path.find_last_of('/');
+    return parse_scene(in, light_sampling, slash == std::string::npos ? "" : path.substr(0, slash), bvh_cache);
+}
+
+void write_binary_scene(std::ostream& out, const Scene& scene) {
+    out.write(binary_magic, sizeof(binary_magic));
+    write_value(out, binary_version);
+    write_value(out, scene.width);
+    write_value(out, scene.height);
+    write_vec3(out, scene.bg_color);
+    write_value(out, scene.camera.camera_fov_x);
+    write_vec3(out, scene.camera.camera_position);
+    write_vec3(out, scene.camera.camera_right);
+    write_vec3(out, scene.camera.camera_up);
+    write_vec3(out, scene.camera.camera_forward);
+    write_value(out, scene.ray_depth);
+    write_value(out, scene.samples);
+
+    BinaryWriter writer{out, {}, {}};
+    writer.collect(scene.primitives);
+    write_value(out, static_cast<std::uint32_t>(writer.meshes.size()));
+    for (const MeshData* mesh : writer.meshes) {
+        write_mesh(out, *mesh);
+    }
+    write_value(out, static_cast<std::uint32_t>(writer.objects.size()));
+    for (const ObjectData* object : writer.objects) {
+        write_value(out, static_cast<std::uint32_t>(object->primitives.size()));
+        for (const Shape* primitive : object->primitives) {
+            writer.write_primitive(primitive);
+        }
+    }
+
+    write_value(out, static_cast<std::uint32_t>(scene.primitives.size()));
+    for (const Shape* primitive : scene.primitives) {
+        writer.write_primitive(primitive);
+    }
+    write_animation(out, scene.animation);
+}
+
 void write_image(const std::string& path, std::uint32_t width, std::uint32_t height, const Image& image) {
     std::ofstream out(path, std::ios::binary);
     if (!out.is_open()) {
@@ -114,4 +590,73 @@ void write_image(const std::string& path, std::uint32_t width, std::uint32_t hei
     out.close();
 }
 
+void write_pfm(const std::string& path, std::uint32_t width, std::uint32_t height, int channels, const float* data) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) {
+        throw std::runtime_error("Bad path to image file.");
+    }
+    // A negative scale marks little-endian floats; PFM stores the bottom row first.
+    out << (channels == 3 ? "PF" : "Pf") << '\n' << width << ' ' << height << "\n-1.0\n";
+    const std::size_t row = static_cast<std::size_t>(width) * channels;
+    for (std::uint32_t y = height; y-- > 0;) {
+        out.write(reinterpret_cast<const char*>(data + y * row), static_cast<std::streamsize>(row * sizeof(float)));
+    }
+}
+
+void write_aovs(const std::function<std::string(AOV)>& path_for,
+                std::uint32_t width,
+                std::uint32_t height,
+                const Aovs& aovs) {
+    auto write_rgb = [&](AOV aov, const HdrImage& buffer) {
+        if (aovs.has(aov)) {
+            write_pfm(path_for(aov), width, height, 3, &buffer.data()->x);
+        }
+    };
+    auto write_single = [&](AOV aov, const auto& buffer) {
+        if (aovs.has(aov)) {
+            std::vector<float> values(buffer.begin(), buffer.end());
+            write_pfm(path_for(aov), width, height, 1, values.data());
+        }
+    };
+    write_single(AOV::Depth, aovs.depth);
+    write_rgb(AOV::Normal, aovs.normal);
+    write_rgb(AOV::Albedo, aovs.albedo);
+    write_single(AOV::Primitive, aovs.primitive);
+    write_single(AOV::Material, aovs.material);
+    write_rgb(AOV::Direct, aovs.direct);
+    write_rgb(AOV::Indirect, aovs.indirect);
+    write_single(AOV::Samples, aovs.samples);
+}
+
+static glm::vec3 heat_color(float t) {
+    static const std::array<glm::vec3, 5> ramp{glm::vec3{0.f, 0.f, 1.f},
+                                               glm::vec3{0.f, 1.f, 1.f},
+                                               glm::vec3{0.f, 1.f, 0.f},
+                                               glm::vec3{1.f, 1.f, 0.f},
+                                               glm::vec3{1.f, 0.f, 0.f}};
+    t = std::clamp(t, 0.f, 1.f) * (ramp.size() - 1);
+    std::size_t i = std::min(static_cast<std::size_t>(t), ramp.size() - 2);
+    float f = t - static_cast<float>(i);
+    return ramp[i] * (1.f - f) + ramp[i + 1] * f;
+}
+
+void write_heatmap(const std::string& path, std::uint32_t width, std::uint32_t height, const CostMap& cost_map) {
+    if (cost_map.empty()) {
+        throw std::runtime_error("Empty cost map.");
+    }
+    CostMap sorted = cost_map;
+    auto p99 = sorted.begin() + (sorted.size() - 1) * 99 / 100;
+    std::nth_element(sorted.begin(), p99, sorted.end());
+    float scale = *p99 == 0 ? 0.f : 1.f / static_cast<float>(*p99);
+
+    Image image(cost_map.size() * 3);
+    for (std::size_t i = 0; i < cost_map.size(); ++i) {
+        glm::vec3 color = heat_color(static_cast<float>(cost_map[i]) * scale);
+        image[i * 3] = static_cast<std::uint8_t>(color.r * 255.f);
+        image[i * 3 + 1] = static_cast<std::uint8_t>(color.g * 255.f);
+        image[i * 3 + 2] = static_cast<std::uint8_t>(color.b * 255.f);
+    }
+    write_image(path, width, height, image);
+}
+
 } // namespace engine::io
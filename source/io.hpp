@@ -3,11 +3,35 @@
 #include "image.hpp"
 #include "scene.hpp"
 
+#include <functional>
+#include <istream>
+#include <ostream>
 #include <string>
 
 namespace engine::io {
 
-Scene load_scene(const std::string& path);
+// Reads a scene in the text format or the binary format of write_binary_scene (told apart by the "RTSB" magic) and
+// prepares it for rendering. The stream must be seekable. Relative MESH paths are resolved against `directory`.
+// A non-empty `bvh_cache` directory is passed on to Scene::init_bvh.
+Scene parse_scene(std::istream& in,
+                  LIGHT_SAMPLING light_sampling = LIGHT_SAMPLING::Tree,
+                  const std::string& directory = "",
+                  const std::string& bvh_cache = "");
+Scene load_scene(const std::string& path,
+                 LIGHT_SAMPLING light_sampling = LIGHT_SAMPLING::Tree,
+                 const std::string& bvh_cache = "");
+// Compact binary form of the scene description: no text parsing on load. Mesh data is embedded, once per file.
+void write_binary_scene(std::ostream& out, const Scene& scene);
 void write_image(const std::string& path, std::uint32_t width, std::uint32_t height, const Image& image);
+// Portable float map: 3 floats per pixel, or 1 with `channels` 1. Rows are given top to bottom.
+void write_pfm(const std::string& path, std::uint32_t width, std::uint32_t height, int channels, const float* data);
+// Writes every enabled AOV to path_for(aov): RGB float maps for normal, albedo, direct and indirect, single channel
+// ones for the rest (primitive and material as their index, -1 on a miss).
+void write_aovs(const std::function<std::string(AOV)>& path_for,
+                std::uint32_t width,
+                std::uint32_t height,
+                const Aovs& aovs);
+// Writes the cost map as a false-color image: blue for cheap pixels through red for the 99th percentile and above.
+void write_heatmap(const std::string& path, std::uint32_t width, std::uint32_t height, const CostMap& cost_map);
 
 } // namespace engine::io
@@ -0,0 +1,42 @@
+#include "kernels.hpp"
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+
+namespace engine {
+
+static const Kernels& kernel_table(ISA isa) {
+    switch (isa) {
+#if defined(ENGINE_X86_KERNELS)
+    case ISA::SSE4:
+        return sse4::kernel_table();
+    case ISA::AVX2:
+        return avx2::kernel_table();
+    case ISA::AVX512:
+        return avx512::kernel_table();
+#endif
+    default:
+        return generic::kernel_table();
+    }
+}
+
+static std::atomic<const Kernels*> selected{nullptr};
+
+const Kernels& kernels() {
+    const Kernels* table = selected.load(std::memory_order_acquire);
+    if (table == nullptr) {
+        table = &kernel_table(detect_isa());
+        selected.store(table, std::memory_order_release);
+    }
+    return *table;
+}
+
+void select_kernels(ISA isa) {
+    if (!isa_supported(isa)) {
+        throw std::runtime_error(std::string("ISA is not supported by this CPU: ") + isa_name(isa));
+    }
+    selected.store(&kernel_table(isa), std::memory_order_release);
+}
+
+} // namespace engine
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "bvh.hpp"
+#include "cpu.hpp"
+#include "flat.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace engine {
+
+// Read-only view of the scene acceleration data for the packet kernels.
+struct PacketScene {
+    const BvhNode* nodes;
+    std::size_t nodes_count;
+    const std::uint32_t* indices;
+    const std::uint32_t* unbounded;
+    std::size_t unbounded_count;
+    const PrimitiveRecord* records;
+};
+
+// One pass of the À-Trous filter (denoise.cpp) over planar float images. Every row holds pad columns of zeros on
+// either side of the width rounded up to 8, so taps up to pad pixels away never leave the row; `valid` is 1 on image
+// pixels and 0 in the padding.
+struct AtrousPass {
+    static constexpr std::size_t pad = 32;
+
+    const float* color[3];
+    float* out[3];
+    const float* albedo[3];
+    const float* normal[3];
+    const float* depth;
+    const float* valid;
+    std::size_t stride;
+    std::uint32_t width;
+    std::uint32_t height;
+    // Distance between taps: 1, 2, 4, ...
+    std::uint32_t step;
+    // Edge-stopping weights are exp(-difference^2 * inverse): squared color, albedo and normal distances and the
+    // squared depth difference relative to the center depth.
+    float color_inverse;
+    float albedo_inverse;
+    float normal_inverse;
+    float depth_inverse;
+};
+
+// SIMD kernels compiled for one ISA level (kernels.inl). Rays are passed in SoA layout: N origin x, N origin y, ...,
+// N direction z.
+struct Kernels {
+    ISA isa;
+    // One ray against a block of primitives: nearest t and the scene index of that primitive, no_hit if none.
+    void (*block_nearest)(
+        const PrimitiveBlock& block, const float* start, const float* direction, float* t, std::uint32_t* index);
+    // Packets of 4 / 8 rays against the BVH: nearest t per lane (+inf on miss) and primitive index (no_hit on miss).
+    void (*packet4_closest)(const PacketScene& scene, const float* rays, float* t, std::uint32_t* primitive);
+    void (*packet8_closest)(const PacketScene& scene, const float* rays, float* t, std::uint32_t* primitive);
+    // count RGB triples of radiance to tone mapped, gamma corrected 8-bit values.
+    void (*tone_map)(const float* hdr, std::size_t count, std::uint8_t* out);
+    // count uniform floats in [0, 1) from 8 xorshift lanes; count is a multiple of 8, state holds 8 non-zero lanes.
+    void (*uniform01)(std::uint32_t* state, float* out, std::size_t count);
+    // Filters one row of pass.color into pass.out with the 5x5 B3-spline kernel spread pass.step pixels apart.
+    void (*atrous_row)(const AtrousPass& pass, std::uint32_t row);
+};
+
+// Kernels of the best ISA the CPU supports unless overridden with select_kernels.
+const Kernels& kernels();
+void select_kernels(ISA isa);
+
+namespace generic {
+const Kernels& kernel_table();
+}
+#if defined(ENGINE_X86_KERNELS)
+namespace sse4 {
+const Kernels& kernel_table();
+}
+namespace avx2 {
+const Kernels& kernel_table();
+}
+namespace avx512 {
+const Kernels& kernel_table();
+}
+#endif
+
+} // namespace engine
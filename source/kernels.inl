@@ -0,0 +1,341 @@
+// Kernel bodies shared by the per-ISA translation units (kernels_*.cpp). Each unit defines ENGINE_KERNELS_NAMESPACE
+// and ENGINE_KERNELS_ISA and is compiled with its own target flags, so everything here must stay inside that
+// namespace and only call always-inline helpers or builtins: an out-of-line glm or std function instantiated with AVX
+// code could be picked by the linker for the baseline callers.
+
+#include "kernels.hpp"
+#include "simd.hpp"
+
+namespace engine::ENGINE_KERNELS_NAMESPACE {
+
+namespace {
+
+constexpr std::uint32_t no_hit = FlatPrimitives::no_hit;
+constexpr std::size_t W = PrimitiveBlock::width;
+constexpr std::size_t max_stack = Bvh::max_depth + 1;
+
+template <std::size_t N>
+struct Rays {
+    simd::vfloat<N> ox, oy, oz;
+    simd::vfloat<N> dx, dy, dz;
+};
+
+template <std::size_t N>
+ENGINE_SIMD_INLINE simd::vfloat<N> infinity() {
+    return simd::broadcast<N>(__builtin_huge_valf());
+}
+
+template <std::size_t N>
+ENGINE_SIMD_INLINE simd::vfloat<N> nearest_ellipsoid(
+    const Rays<N>& local, simd::vfloat<N> inv_rx, simd::vfloat<N> inv_ry, simd::vfloat<N> inv_rz) {
+    simd::vfloat<N> ox = local.ox * inv_rx;
+    simd::vfloat<N> oy = local.oy * inv_ry;
+    simd::vfloat<N> oz = local.oz * inv_rz;
+    simd::vfloat<N> dx = local.dx * inv_rx;
+    simd::vfloat<N> dy = local.dy * inv_ry;
+    simd::vfloat<N> dz = local.dz * inv_rz;
+
+    simd::vfloat<N> a = dx * dx + dy * dy + dz * dz;
+    simd::vfloat<N> b = ox * dx + oy * dy + oz * dz;
+    simd::vfloat<N> c = ox * ox + oy * oy + oz * oz - 1.f;
+    simd::vfloat<N> D = b * b - a * c;
+    simd::vfloat<N> sqrt_D = simd::sqrt<N>(simd::max<N>(D, simd::broadcast<N>(0.f)));
+    simd::vfloat<N> t_1 = (-b - sqrt_D) / a;
+    simd::vfloat<N> t_2 = (-b + sqrt_D) / a;
+
+    simd::vfloat<N> inf = infinity<N>();
+    simd::vfloat<N> t = simd::select<N>(t_1 >= 0.f, t_1, simd::select<N>(t_2 >= 0.f, t_2, inf));
+    return simd::select<N>(D >= 0.f, t, inf);
+}
+
+template <std::size_t N>
+ENGINE_SIMD_INLINE simd::vfloat<N> nearest_box(
+    const Rays<N>& local, simd::vfloat<N> sx, simd::vfloat<N> sy, simd::vfloat<N> sz) {
+    simd::vfloat<N> tx_1 = (sx - local.ox) / local.dx;
+    simd::vfloat<N> tx_2 = (-sx - local.ox) / local.dx;
+    simd::vfloat<N> ty_1 = (sy - local.oy) / local.dy;
+    simd::vfloat<N> ty_2 = (-sy - local.oy) / local.dy;
+    simd::vfloat<N> tz_1 = (sz - local.oz) / local.dz;
+    simd::vfloat<N> tz_2 = (-sz - local.oz) / local.dz;
+
+    simd::vfloat<N> t_1 = simd::max<N>(simd::min<N>(tx_1, tx_2),
+                                       simd::max<N>(simd::min<N>(ty_1, ty_2), simd::min<N>(tz_1, tz_2)));
+    simd::vfloat<N> t_2 = simd::min<N>(simd::max<N>(tx_1, tx_2),
+                                       simd::min<N>(simd::max<N>(ty_1, ty_2), simd::max<N>(tz_1, tz_2)));
+
+    simd::vfloat<N> t = simd::select<N>(t_1 < 0.f, t_2, t_1);
+    return simd::select<N>((t_1 <= t_2) & (t_2 >= 0.f), t, infinity<N>());
+}
+
+template <std::size_t N>
+ENGINE_SIMD_INLINE simd::vfloat<N> nearest_plane(const Rays<N>& local, const float* normal) {
+    simd::vfloat<N> t = -(local.ox * normal[0] + local.oy * normal[1] + local.oz * normal[2]) /
+                        (local.dx * normal[0] + local.dy * normal[1] + local.dz * normal[2]);
+    return simd::select<N>(t >= 0.f, t, infinity<N>());
+}
+
+// A packet of rays against a single primitive.
+template <std::size_t N>
+ENGINE_SIMD_INLINE simd::vfloat<N> intersect_record(const Rays<N>& rays, const PrimitiveRecord& record) {
+    const float* m = record.rotation;
+    simd::vfloat<N> px = rays.ox - record.position[0];
+    simd::vfloat<N> py = rays.oy - record.position[1];
+    simd::vfloat<N> pz = rays.oz - record.position[2];
+
+    Rays<N> local;
+    local.ox = m[0] * px + m[1] * py + m[2] * pz;
+    local.oy = m[3] * px + m[4] * py + m[5] * pz;
+    local.oz = m[6] * px + m[7] * py + m[8] * pz;
+    local.dx = m[0] * rays.dx + m[1] * rays.dy + m[2] * rays.dz;
+    local.dy = m[3] * rays.dx + m[4] * rays.dy + m[5] * rays.dz;
+    local.dz = m[6] * rays.dx + m[7] * rays.dy + m[8] * rays.dz;
+
+    switch (record.type) {
+    case PRIMITIVE_TYPE::Plane:
+        return nearest_plane<N>(local, record.extent);
+    case PRIMITIVE_TYPE::Ellipsoid:
+        return nearest_ellipsoid<N>(local, simd::broadcast<N>(record.extent[0]), simd::broadcast<N>(record.extent[1]),
+                                    simd::broadcast<N>(record.extent[2]));
+    default:
+        return nearest_box<N>(local, simd::broadcast<N>(record.extent[0]), simd::broadcast<N>(record.extent[1]),
+                              simd::broadcast<N>(record.extent[2]));
+    }
+}
+
+// Lanes whose ray enters the box before t_max.
+template <std::size_t N>
+ENGINE_SIMD_INLINE simd::vmask<N> intersect_aabb(const Rays<N>& rays,
+                                                 const Rays<N>& inv,
+                                                 const Aabb& bounds,
+                                                 simd::vfloat<N> t_max) {
+    simd::vfloat<N> tx_1 = (bounds.min.x - rays.ox) * inv.dx;
+    simd::vfloat<N> tx_2 = (bounds.max.x - rays.ox) * inv.dx;
+    simd::vfloat<N> ty_1 = (bounds.min.y - rays.oy) * inv.dy;
+    simd::vfloat<N> ty_2 = (bounds.max.y - rays.oy) * inv.dy;
+    simd::vfloat<N> tz_1 = (bounds.min.z - rays.oz) * inv.dz;
+    simd::vfloat<N> tz_2 = (bounds.max.z - rays.oz) * inv.dz;
+
+    simd::vfloat<N> t_enter = simd::max<N>(simd::max<N>(simd::min<N>(tx_1, tx_2), simd::min<N>(ty_1, ty_2)),
+                                           simd::max<N>(simd::min<N>(tz_1, tz_2), simd::broadcast<N>(0.f)));
+    simd::vfloat<N> t_exit = simd::min<N>(simd::min<N>(simd::max<N>(tx_1, tx_2), simd::max<N>(ty_1, ty_2)),
+                                          simd::min<N>(simd::max<N>(tz_1, tz_2), t_max));
+    return t_enter <= t_exit;
+}
+
+template <std::size_t N>
+ENGINE_SIMD_INLINE void closer_hits(
+    const Rays<N>& rays, const PacketScene& scene, std::uint32_t index, simd::vfloat<N>& best_t, std::uint32_t* best) {
+    simd::vfloat<N> t = intersect_record<N>(rays, scene.records[index]);
+    simd::vmask<N> closer = t < best_t;
+    best_t = simd::select<N>(closer, t, best_t);
+    for (std::size_t lane = 0; lane < N; ++lane) {
+        if (closer[lane]) {
+            best[lane] = index;
+        }
+    }
+}
+
+template <std::size_t N>
+void packet_closest(const PacketScene& scene, const float* data, float* t, std::uint32_t* primitive) {
+    Rays<N> rays;
+    rays.ox = simd::load<N>(data);
+    rays.oy = simd::load<N>(data + N);
+    rays.oz = simd::load<N>(data + 2 * N);
+    rays.dx = simd::load<N>(data + 3 * N);
+    rays.dy = simd::load<N>(data + 4 * N);
+    rays.dz = simd::load<N>(data + 5 * N);
+    Rays<N> inv;
+    inv.dx = 1.f / rays.dx;
+    inv.dy = 1.f / rays.dy;
+    inv.dz = 1.f / rays.dz;
+
+    simd::vfloat<N> best_t = infinity<N>();
+    for (std::size_t lane = 0; lane < N; ++lane) {
+        primitive[lane] = no_hit;
+    }
+    for (std::size_t i = 0; i < scene.unbounded_count; ++i) {
+        closer_hits<N>(rays, scene, scene.unbounded[i], best_t, primitive);
+    }
+
+    if (scene.nodes_count > 0) {
+        std::uint32_t stack[max_stack];
+        std::size_t stack_size = 0;
+        stack[stack_size++] = 0;
+        while (stack_size > 0) {
+            std::uint32_t node_index = stack[--stack_size];
+            const BvhNode& node = scene.nodes[node_index];
+            if (!simd::any<N>(intersect_aabb<N>(rays, inv, node.bounds, best_t))) {
+                continue;
+            }
+            if (node.count > 0) {
+                for (std::uint32_t i = 0; i < node.count; ++i) {
+                    closer_hits<N>(rays, scene, scene.indices[node.offset + i], best_t, primitive);
+                }
+            }
+            else {
+                stack[stack_size++] = node.offset;
+                stack[stack_size++] = node_index + 1;
+            }
+        }
+    }
+    simd::store<N>(t, best_t);
+}
+
+void packet4_closest(const PacketScene& scene, const float* rays, float* t, std::uint32_t* primitive) {
+    packet_closest<4>(scene, rays, t, primitive);
+}
+
+void packet8_closest(const PacketScene& scene, const float* rays, float* t, std::uint32_t* primitive) {
+    packet_closest<8>(scene, rays, t, primitive);
+}
+
+// One ray against up to W primitives of the same type stored in SoA.
+void block_nearest(
+    const PrimitiveBlock& block, const float* start, const float* direction, float* t_out, std::uint32_t* index) {
+    simd::vfloat<W> px = start[0] - simd::load<W>(block.position[0]);
+    simd::vfloat<W> py = start[1] - simd::load<W>(block.position[1]);
+    simd::vfloat<W> pz = start[2] - simd::load<W>(block.position[2]);
+
+    simd::vfloat<W> m[9];
+    for (int i = 0; i < 9; ++i) {
+        m[i] = simd::load<W>(block.rotation[i]);
+    }
+    Rays<W> local;
+    local.ox = m[0] * px + m[1] * py + m[2] * pz;
+    local.oy = m[3] * px + m[4] * py + m[5] * pz;
+    local.oz = m[6] * px + m[7] * py + m[8] * pz;
+    local.dx = m[0] * direction[0] + m[1] * direction[1] + m[2] * direction[2];
+    local.dy = m[3] * direction[0] + m[4] * direction[1] + m[5] * direction[2];
+    local.dz = m[6] * direction[0] + m[7] * direction[1] + m[8] * direction[2];
+
+    simd::vfloat<W> ex = simd::load<W>(block.extent[0]);
+    simd::vfloat<W> ey = simd::load<W>(block.extent[1]);
+    simd::vfloat<W> ez = simd::load<W>(block.extent[2]);
+    simd::vfloat<W> t = block.type == PRIMITIVE_TYPE::Ellipsoid ? nearest_ellipsoid<W>(local, ex, ey, ez)
+                                                                : nearest_box<W>(local, ex, ey, ez);
+
+    // Masked min: padding lanes never win, then the lane holding the minimum gives the primitive.
+    const simd::vmask<W> lanes{0, 1, 2, 3, 4, 5, 6, 7};
+    t = simd::select<W>(lanes < static_cast<std::int32_t>(block.count), t, infinity<W>());
+    float best_t = t[0];
+    std::uint32_t best_lane = 0;
+    for (std::uint32_t lane = 1; lane < W; ++lane) {
+        if (t[lane] < best_t) {
+            best_t = t[lane];
+            best_lane = lane;
+        }
+    }
+    *t_out = best_t;
+    *index = best_t == __builtin_huge_valf() ? no_hit : block.index[best_lane];
+}
+
+// Same curve as color_converter: ACES fit, clamp, gamma 2.2, round to 8 bits.
+void tone_map(const float* hdr, std::size_t count, std::uint8_t* out) {
+    constexpr std::size_t V = 8;
+    const std::size_t values = count * 3;
+    std::size_t i = 0;
+    for (; i + V <= values; i += V) {
+        simd::vfloat<V> in = simd::load<V>(hdr + i);
+        simd::vfloat<V> color = (in * (2.51f * in + 0.03f)) / (in * (2.43f * in + 0.59f) + 0.14f);
+        color = simd::min<V>(simd::max<V>(color, simd::broadcast<V>(0.f)), simd::broadcast<V>(1.f));
+        for (std::size_t lane = 0; lane < V; ++lane) {
+            float gamma = static_cast<float>(__builtin_pow(color[lane], 1.0 / 2.2)) * 255.f;
+            out[i + lane] = static_cast<std::uint8_t>(__builtin_roundf(gamma));
+        }
+    }
+    for (; i < values; ++i) {
+        float in = hdr[i];
+        float color = (in * (2.51f * in + 0.03f)) / (in * (2.43f * in + 0.59f) + 0.14f);
+        color = color < 0.f ? 0.f : (color > 1.f ? 1.f : color);
+        float gamma = static_cast<float>(__builtin_pow(color, 1.0 / 2.2)) * 255.f;
+        out[i] = static_cast<std::uint8_t>(__builtin_roundf(gamma));
+    }
+}
+
+// 8 interleaved xorshift32 generators; the top 24 bits of each state give a float in [0, 1).
+void uniform01(std::uint32_t* state, float* out, std::size_t count) {
+    constexpr std::size_t V = 8;
+    simd::vuint<V> x;
+    __builtin_memcpy(&x, state, sizeof(x));
+    for (std::size_t i = 0; i < count; i += V) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        simd::vfloat<V> value = __builtin_convertvector(x >> 8, simd::vfloat<V>) * (1.f / 16777216.f);
+        simd::store<V>(out + i, value);
+    }
+    __builtin_memcpy(state, &x, sizeof(x));
+}
+
+void atrous_row(const AtrousPass& pass, std::uint32_t row) {
+    constexpr std::size_t V = 8;
+    constexpr float kernel[5] = {1.f / 16.f, 1.f / 4.f, 3.f / 8.f, 1.f / 4.f, 1.f / 16.f};
+    const int step = static_cast<int>(pass.step);
+    const std::size_t center_row = row * pass.stride + AtrousPass::pad;
+    for (std::size_t x = 0; x < pass.width; x += V) {
+        const std::size_t p = center_row + x;
+        simd::vfloat<V> cr = simd::load<V>(pass.color[0] + p);
+        simd::vfloat<V> cg = simd::load<V>(pass.color[1] + p);
+        simd::vfloat<V> cb = simd::load<V>(pass.color[2] + p);
+        simd::vfloat<V> ar = simd::load<V>(pass.albedo[0] + p);
+        simd::vfloat<V> ag = simd::load<V>(pass.albedo[1] + p);
+        simd::vfloat<V> ab = simd::load<V>(pass.albedo[2] + p);
+        simd::vfloat<V> nx = simd::load<V>(pass.normal[0] + p);
+        simd::vfloat<V> ny = simd::load<V>(pass.normal[1] + p);
+        simd::vfloat<V> nz = simd::load<V>(pass.normal[2] + p);
+        simd::vfloat<V> z = simd::load<V>(pass.depth + p);
+        simd::vfloat<V> depth_inverse = pass.depth_inverse / (z * z + 1e-6f);
+
+        simd::vfloat<V> sum_r{}, sum_g{}, sum_b{}, weights{};
+        for (int dy = -2; dy <= 2; ++dy) {
+            const int y = static_cast<int>(row) + dy * step;
+            if (y < 0 || y >= static_cast<int>(pass.height)) {
+                continue;
+            }
+            const std::size_t tap_row = static_cast<std::size_t>(y) * pass.stride + AtrousPass::pad + x;
+            for (int dx = -2; dx <= 2; ++dx) {
+                const std::size_t q = tap_row + dx * step;
+                simd::vfloat<V> qr = simd::load<V>(pass.color[0] + q);
+                simd::vfloat<V> qg = simd::load<V>(pass.color[1] + q);
+                simd::vfloat<V> qb = simd::load<V>(pass.color[2] + q);
+                simd::vfloat<V> dr = qr - cr, dg = qg - cg, db = qb - cb;
+                simd::vfloat<V> dar = simd::load<V>(pass.albedo[0] + q) - ar;
+                simd::vfloat<V> dag = simd::load<V>(pass.albedo[1] + q) - ag;
+                simd::vfloat<V> dab = simd::load<V>(pass.albedo[2] + q) - ab;
+                simd::vfloat<V> dnx = simd::load<V>(pass.normal[0] + q) - nx;
+                simd::vfloat<V> dny = simd::load<V>(pass.normal[1] + q) - ny;
+                simd::vfloat<V> dnz = simd::load<V>(pass.normal[2] + q) - nz;
+                simd::vfloat<V> dz = simd::load<V>(pass.depth + q) - z;
+                simd::vfloat<V> exponent = -(dr * dr + dg * dg + db * db) * pass.color_inverse -
+                                           (dar * dar + dag * dag + dab * dab) * pass.albedo_inverse -
+                                           (dnx * dnx + dny * dny + dnz * dnz) * pass.normal_inverse -
+                                           dz * dz * depth_inverse;
+                // Far-off taps get weight 0 rather than denormal weights, which would slow every later operation.
+                simd::vfloat<V> w = simd::select<V>(exponent > -40.f, simd::exp_negative<V>(exponent),
+                                                    simd::broadcast<V>(0.f)) *
+                                    simd::load<V>(pass.valid + q) * (kernel[dy + 2] * kernel[dx + 2]);
+                sum_r += w * qr;
+                sum_g += w * qg;
+                sum_b += w * qb;
+                weights += w;
+            }
+        }
+        // The center tap has weight 1 on image pixels; padding lanes keep their zeros.
+        simd::vmask<V> inside = simd::load<V>(pass.valid + p) > 0.f;
+        simd::vfloat<V> inverse = 1.f / simd::max<V>(weights, simd::broadcast<V>(1e-20f));
+        simd::store<V>(pass.out[0] + p, simd::select<V>(inside, sum_r * inverse, simd::broadcast<V>(0.f)));
+        simd::store<V>(pass.out[1] + p, simd::select<V>(inside, sum_g * inverse, simd::broadcast<V>(0.f)));
+        simd::store<V>(pass.out[2] + p, simd::select<V>(inside, sum_b * inverse, simd::broadcast<V>(0.f)));
+    }
+}
+
+} // namespace
+
+const Kernels& kernel_table() {
+    static const Kernels table{
+        ENGINE_KERNELS_ISA, block_nearest, packet4_closest, packet8_closest, tone_map, uniform01, atrous_row,
+    };
+    return table;
+}
+
+} // namespace engine::ENGINE_KERNELS_NAMESPACE
@@ -0,0 +1,4 @@
+// Kernels for the avx2 instruction set level, see kernels.inl.
+#define ENGINE_KERNELS_NAMESPACE avx2
+#define ENGINE_KERNELS_ISA ISA::AVX2
+#include "kernels.inl"
@@ -0,0 +1,4 @@
+// Kernels for the avx512 instruction set level, see kernels.inl.
+#define ENGINE_KERNELS_NAMESPACE avx512
+#define ENGINE_KERNELS_ISA ISA::AVX512
+#include "kernels.inl"
@@ -0,0 +1,4 @@
+// Kernels for the generic instruction set level, see kernels.inl.
+#define ENGINE_KERNELS_NAMESPACE generic
+#define ENGINE_KERNELS_ISA ISA::Generic
+#include "kernels.inl"
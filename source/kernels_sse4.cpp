@@ -0,0 +1,4 @@
+// Kernels for the sse4 instruction set level, see kernels.inl.
+#define ENGINE_KERNELS_NAMESPACE sse4
+#define ENGINE_KERNELS_ISA ISA::SSE4
+#include "kernels.inl"
@@ -0,0 +1,170 @@
+#include "light_tree.hpp"
+#include "glm/geometric.hpp"
+#include "mesh.hpp"
+#include "ray.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace engine::rand {
+
+namespace {
+
+float surface_area(const Shape* shape) {
+    switch (shape->type) {
+    case PRIMITIVE_TYPE::Ellipsoid: {
+        // Knud Thomsen's approximation, within about 1% of the exact area.
+        const glm::vec3& r = dynamic_cast<const Ellipsoid*>(shape)->radius;
+        const float p = 1.6075f;
+        float ab = std::pow(r.x * r.y, p);
+        float ac = std::pow(r.x * r.z, p);
+        float bc = std::pow(r.y * r.z, p);
+        return 4.f * pi * std::pow((ab + ac + bc) / 3.f, 1.f / p);
+    }
+    case PRIMITIVE_TYPE::Box: {
+        const glm::vec3& s = dynamic_cast<const Box*>(shape)->size;
+        return 8.f * (s.x * s.y + s.y * s.z + s.x * s.z);
+    }
+    case PRIMITIVE_TYPE::Mesh:
+        return dynamic_cast<const Mesh*>(shape)->data->area;
+    default:
+        throw std::runtime_error("Emitter has no finite area");
+    }
+}
+
+// Upper bound of the contribution of everything inside the bounds to a receiver at x with normal n.
+float importance(const Aabb& bounds, float power, glm::vec3 x, glm::vec3 n) {
+    glm::vec3 center = bounds.center();
+    float radius2 = 0.25f * glm::dot(bounds.max - bounds.min, bounds.max - bounds.min);
+    glm::vec3 to_center = center - x;
+    float dist2 = glm::dot(to_center, to_center);
+    if (dist2 <= radius2) {
+        return power / std::max(radius2, eps);
+    }
+
+    float dist = std::sqrt(dist2);
+    float cos_i = glm::dot(n, to_center) / dist;
+    float sin_b2 = radius2 / dist2;
+    float cos_b = std::sqrt(1.f - sin_b2);
+    // cos(max(0, theta_i - theta_b)): the smallest angle between n and a direction into the bounding sphere.
+    float cos_bound = 1.f;
+    if (cos_i < cos_b) {
+        float sin_i = std::sqrt(std::max(0.f, 1.f - cos_i * cos_i));
+        cos_bound = cos_i * cos_b + sin_i * std::sqrt(sin_b2);
+    }
+    return cos_bound <= 0.f ? 0.f : power * cos_bound / dist2;
+}
+
+} // namespace
+
+float emitter_power(const Shape* shape) {
+    float luminance = 0.2126f * shape->emission.r + 0.7152f * shape->emission.g + 0.0722f * shape->emission.b;
+    return std::max(luminance, 0.f) * surface_area(shape);
+}
+
+LightTree::LightTree(const std::vector<Shape*>& emitters) {
+    if (emitters.empty()) {
+        throw std::runtime_error("Light tree needs at least one emitter");
+    }
+    std::vector<std::uint32_t> order(emitters.size());
+    for (std::uint32_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+        lights.emplace_back(std::make_unique<Light>(emitters[i]));
+    }
+    nodes.reserve(2 * emitters.size());
+    build(order.begin(), order.end(), emitters);
+}
+
+// Median split along the widest axis of the emitter centers: the tree stays balanced, which bounds its depth by
+// log2 of the emitter count.
+std::uint32_t LightTree::build(std::vector<std::uint32_t>::iterator begin,
+                               std::vector<std::uint32_t>::iterator end,
+                               const std::vector<Shape*>& emitters) {
+    std::uint32_t index = static_cast<std::uint32_t>(nodes.size());
+    nodes.emplace_back();
+    if (end - begin == 1) {
+        nodes[index].bounds = shape_bounds(emitters[*begin]);
+        nodes[index].power = emitter_power(emitters[*begin]);
+        nodes[index].offset = *begin;
+        nodes[index].leaf = true;
+        return index;
+    }
+
+    Aabb centers;
+    for (auto it = begin; it != end; ++it) {
+        centers.extend(emitters[*it]->position);
+    }
+    glm::vec3 extent = centers.max - centers.min;
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    auto middle = begin + (end - begin) / 2;
+    std::nth_element(begin, middle, end, [&](std::uint32_t a, std::uint32_t b) {
+        return emitters[a]->position[axis] < emitters[b]->position[axis];
+    });
+
+    std::uint32_t left = build(begin, middle, emitters);
+    std::uint32_t right = build(middle, end, emitters);
+    LightNode& node = nodes[index];
+    node.bounds = nodes[left].bounds;
+    node.bounds.extend(nodes[right].bounds);
+    node.power = nodes[left].power + nodes[right].power;
+    node.offset = right;
+    node.leaf = false;
+    return index;
+}
+
+float LightTree::left_probability(const LightNode& node, glm::vec3 x, glm::vec3 n) const {
+    std::uint32_t index = static_cast<std::uint32_t>(&node - nodes.data());
+    const LightNode& left = nodes[index + 1];
+    const LightNode& right = nodes[node.offset];
+    float left_importance = importance(left.bounds, left.power, x, n);
+    float right_importance = importance(right.bounds, right.power, x, n);
+    float sum = left_importance + right_importance;
+    return sum > 0.f ? left_importance / sum : 0.5f;
+}
+
+glm::vec3 LightTree::sample(glm::vec3 x, glm::vec3 n, float time) {
+    std::uint32_t index = 0;
+    while (!nodes[index].leaf) {
+        float p_left = left_probability(nodes[index], x, n);
+        index = Rng::get_instance().uniform_01() < p_left ? index + 1 : nodes[index].offset;
+    }
+    return lights[nodes[index].offset]->sample(x, n, time);
+}
+
+float LightTree::pdf(glm::vec3 x, glm::vec3 n, glm::vec3 d, float time) {
+    ray::Ray r;
+    r.start = x;
+    r.direction = d;
+    glm::vec3 inv_direction = 1.f / d;
+    const float t_max = std::numeric_limits<float>::infinity();
+
+    // Nodes the direction passes through, with the probability of the tree walk reaching them.
+    std::array<std::pair<std::uint32_t, float>, 64> stack;
+    std::size_t stack_size = 0;
+    stack[stack_size++] = {0, 1.f};
+    float result = 0.f;
+    while (stack_size > 0) {
+        auto [index, probability] = stack[--stack_size];
+        const LightNode& node = nodes[index];
+        if (!ray::intersect_aabb(r, inv_direction, node.bounds, t_max)) {
+            continue;
+        }
+        if (node.leaf) {
+            result += probability * lights[node.offset]->pdf(x, n, d, time);
+            continue;
+        }
+        float p_left = left_probability(node, x, n);
+        if (p_left < 1.f) {
+            stack[stack_size++] = {node.offset, probability * (1.f - p_left)};
+        }
+        if (p_left > 0.f) {
+            stack[stack_size++] = {index + 1, probability * p_left};
+        }
+    }
+    return result;
+}
+
+} // namespace engine::rand
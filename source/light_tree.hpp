@@ -0,0 +1,46 @@
+#pragma once
+
+#include "bvh.hpp"
+#include "distributions.hpp"
+#include "primitive.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace engine::rand {
+
+// Emitted power used to weight light selection: luminance of the emission times the surface area.
+float emitter_power(const Shape* shape);
+
+struct LightNode {
+    Aabb bounds;
+    float power;
+    // Leaf: index in LightTree::lights. Interior: index of the right child, the left child follows the node.
+    std::uint32_t offset;
+    bool leaf;
+};
+
+// Binary tree over the emitters. Every interior node picks one of its children with probability proportional to an
+// importance estimate (power, distance and the cosine bound of the child's bounding sphere seen from the shading
+// point), so sampling walks one root-to-leaf path and pdf only visits the nodes whose bounds the direction crosses.
+// All emitters are closed surfaces emitting in every direction, so the emission cone of every node is the full
+// sphere and only the receiver side of the cone bound matters.
+class LightTree : public IDistribution {
+public:
+    LightTree(const std::vector<Shape*>& emitters);
+
+    glm::vec3 sample(glm::vec3 x, glm::vec3 n, float time) final;
+    float pdf(glm::vec3 x, glm::vec3 n, glm::vec3 d, float time) final;
+
+private:
+    std::uint32_t build(std::vector<std::uint32_t>::iterator begin,
+                        std::vector<std::uint32_t>::iterator end,
+                        const std::vector<Shape*>& emitters);
+    float left_probability(const LightNode& node, glm::vec3 x, glm::vec3 n) const;
+
+    std::vector<LightNode> nodes;
+    std::vector<std::unique_ptr<Light>> lights;
+};
+
+} // namespace engine::rand
@@ -1,41 +1,540 @@
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <optional>
+#include <random>
+#include <sstream>
 #include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
 
+#include "batch.hpp"
+#include "farm.hpp"
 #include "io.hpp"
+#include "kernels.hpp"
+#include "raytracer.hpp"
+#include "sequence.hpp"
+#include "server.hpp"
+#include "shard.hpp"
+#include "trace.hpp"
 
 static bool verbose = false;
-static bool multithread = false;
+static std::string trace_path;
+static bool wavefront = false;
+static std::size_t packet_width = 0;
+static bool heatmap = false;
+static engine::COST_METRIC heatmap_metric = engine::COST_METRIC::Cycles;
+static std::string isa;
+static std::uint32_t samples = 0;
+static bool binary_scene = false;
+static bool sequence = false;
+static bool denoise = false;
+static bool affinity = false;
+static bool numa_replicas = false;
+static std::string aov_names;
+static std::string bvh_cache;
+static std::optional<std::uint64_t> seed;
+static engine::Region region;
+static std::string tiles;
+static std::string sample_split;
+static engine::farm::CoordinatorOptions farm;
+static std::uint32_t local_workers = 0;
+static engine::LIGHT_SAMPLING light_sampling = engine::LIGHT_SAMPLING::Tree;
+// Unset: single-threaded renders, one thread per hardware thread in batch mode.
+static std::optional<std::size_t> threads;
+
+// "out/render.ppm" -> "out/render_heatmap.ppm"
+static std::string heatmap_path(const std::string& image_path) {
+    std::size_t slash = image_path.find_last_of('/');
+    std::size_t dot = image_path.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return image_path + "_heatmap";
+    }
+    return image_path.substr(0, dot) + "_heatmap" + image_path.substr(dot);
+}
+
+// "out/render.ppm" -> "out/render_depth.pfm"
+static std::string aov_path(const std::string& image_path, engine::AOV aov) {
+    std::size_t slash = image_path.find_last_of('/');
+    std::size_t dot = image_path.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        dot = image_path.size();
+    }
+    return image_path.substr(0, dot) + '_' + engine::aov_name(aov) + ".pfm";
+}
+
+// Decimal value of a command line option, at most `max`; throws naming the option otherwise.
+static std::uint64_t parse_unsigned(const std::string& option,
+                                    const std::string& text,
+                                    std::uint64_t max = std::numeric_limits<std::uint32_t>::max()) {
+    std::uint64_t value = 0;
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (text.empty() || error != std::errc() || end != text.data() + text.size() || value > max) {
+        throw std::runtime_error("Bad value for " + option + ": " + text);
+    }
+    return value;
+}
+
+static double parse_seconds(const std::string& option, const std::string& text) {
+    std::size_t end = 0;
+    double value = -1.0;
+    try {
+        value = std::stod(text, &end);
+    }
+    catch (const std::exception&) {
+    }
+    if (end != text.size() || !(value >= 0.0)) {
+        throw std::runtime_error("Bad value for " + option + ": " + text);
+    }
+    return value;
+}
+
+// "host:port" or "port" -> {host, port}
+static std::pair<std::string, std::uint16_t> parse_endpoint(const std::string& text, const std::string& default_host) {
+    std::size_t colon = text.find_last_of(':');
+    std::string host = colon == std::string::npos ? default_host : text.substr(0, colon);
+    std::uint64_t port = parse_unsigned("port", colon == std::string::npos ? text : text.substr(colon + 1), 65535);
+    return {host, static_cast<std::uint16_t>(port)};
+}
+
+// Merged partial images to a PFM of linear radiance if the path ends in ".pfm", a tone mapped image otherwise.
+static void write_merged(const std::string& path, const engine::shard::Partial& image) {
+    engine::trace::Span span("write_image");
+    if (path.size() >= 4 && path.compare(path.size() - 4, 4, ".pfm") == 0) {
+        engine::io::write_pfm(path, image.width, image.height, 3, reinterpret_cast<const float*>(image.radiance.data()));
+    }
+    else {
+        engine::io::write_image(path, image.width, image.height, engine::post_process(image.radiance));
+    }
+}
+
+// Renders the scene in `count` processes that each take a slice of the samples, then merges their parts into
+// image_path. `options` are passed on to every process, except -v and -trace.
+static void render_split(const char* program,
+                         std::uint32_t count,
+                         const std::string& scene_path,
+                         const std::string& image_path,
+                         const std::vector<std::string>& options) {
+    std::vector<std::vector<std::string>> commands;
+    std::vector<std::string> parts;
+    for (std::uint32_t i = 0; i < count; ++i) {
+        parts.push_back(image_path + ".part" + std::to_string(i));
+        std::vector<std::string> command{program, scene_path, parts.back()};
+        for (std::size_t j = 0; j < options.size(); ++j) {
+            // Keep the processes quiet and off the launcher's trace file.
+            if (options[j] == "-trace") {
+                ++j;
+            }
+            else if (options[j] != "-v") {
+                command.push_back(options[j]);
+            }
+        }
+        command.push_back("-sample-split");
+        command.push_back(std::to_string(i) + '/' + std::to_string(count));
+        if (!seed.has_value()) {
+            // Every process must draw from the same streams.
+            static const std::uint64_t shared_seed = std::random_device{}();
+            command.push_back("-seed");
+            command.push_back(std::to_string(shared_seed));
+        }
+        commands.push_back(std::move(command));
+    }
+    engine::shard::run_processes(commands);
+    write_merged(image_path, engine::shard::merge(parts));
+    for (const std::string& part : parts) {
+        std::remove(part.c_str());
+    }
+}
 
 int main(int argc, char* argv[]) {
-    if (argc < 3 || argc > 5) {
-        std::cout << "Usage: ./engine <path-to-scene> <path-to-image> [-v] [-thread]\n";
+    if (argc < 3) {
+        std::cout << "Usage: ./engine <path-to-scene> <path-to-image> [options]\n"
+                     "       ./engine -batch <path-to-manifest> [options]\n"
+                     "       ./engine --serve <path-to-socket> [options]\n"
+                     "       ./engine --client <path-to-socket> <path-to-scene> <path-to-image> [options] [-binary]\n"
+                     "       ./engine --merge <path-to-image> <path-to-partial>...\n"
+                     "       ./engine --split <n> <path-to-scene> <path-to-image> [options]\n"
+                     "       ./engine --coordinate [<address>:]<port> <path-to-scene> <path-to-image> [options]\n"
+                     "                [-farm-tiles <n>] [-farm-slices <n>] [-task-timeout <seconds>] [-local-workers <n>]\n"
+                     "       ./engine --worker <host>:<port> [-threads <n>] [-isa <...>] [-bvh-cache <directory>] [-v]\n"
+                     "Options: [-v] [-thread] [-threads <n>] [-samples <n>] [-seed <n>] [-trace <path-to-trace>]\n"
+                     "         [-wavefront] [-packets <4|8>] [-heatmap | -heatmap-rays] [-isa <generic|sse4|avx2|avx512>]\n"
+                     "         [-lights <uniform|tree|power>] [-sequence]\n"
+                     "         [-bvh-cache <directory>] [-denoise] [-aov <name,...|all>]\n"
+                     "         [-region <x0> <y0> <x1> <y1> | -tiles <i>/<n>] [-sample-split <i>/<n>]\n"
+                     "         [-affinity] [-numa-replicas]\n";
+        return EXIT_FAILURE;
+    }
+    const std::string mode(argv[1]);
+    const bool batch = mode == "-batch";
+    const bool serve = mode == "--serve";
+    const bool client = mode == "--client";
+    const bool split = mode == "--split";
+    const bool coordinate = mode == "--coordinate";
+    const bool worker = mode == "--worker";
+    if (mode == "--merge") {
+        try {
+            write_merged(argv[2], engine::shard::merge(std::vector<std::string>(argv + 3, argv + argc)));
+        }
+        catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+    if (client && argc < 5) {
+        std::cout << "Usage: ./engine --client <path-to-socket> <path-to-scene> <path-to-image> [options]\n";
+        return EXIT_FAILURE;
+    }
+    if (split && argc < 5) {
+        std::cout << "Usage: ./engine --split <n> <path-to-scene> <path-to-image> [options]\n";
+        return EXIT_FAILURE;
+    }
+    if (coordinate && argc < 5) {
+        std::cout << "Usage: ./engine --coordinate [<address>:]<port> <path-to-scene> <path-to-image> [options]\n";
         return EXIT_FAILURE;
     }
-    if (argc > 3) {
-        for (std::size_t i = 3; i < argc; ++i) {
-            if (std::string(argv[i]) == "-v") {
+    try {
+        for (int i = client || split || coordinate ? 5 : 3; i < argc; ++i) {
+            std::string arg(argv[i]);
+            if (arg == "-v") {
                 verbose = true;
             }
-            else if (std::string(argv[i]) == "-thread") {
-                multithread = true;
+            else if (arg == "-thread") {
+                threads = 0;
+            }
+            else if (arg == "-threads" && i + 1 < argc) {
+                threads = parse_unsigned(arg, argv[++i]);
+            }
+            else if (arg == "-samples" && i + 1 < argc) {
+                samples = static_cast<std::uint32_t>(parse_unsigned(arg, argv[++i]));
+            }
+            else if (arg == "-seed" && i + 1 < argc) {
+                seed = parse_unsigned(arg, argv[++i], std::numeric_limits<std::uint64_t>::max());
+            }
+            else if (arg == "-trace" && i + 1 < argc) {
+                trace_path = argv[++i];
+            }
+            else if (arg == "-sequence") {
+                sequence = true;
+            }
+            else if (arg == "-region" && i + 4 < argc) {
+                region.x0 = static_cast<std::uint32_t>(parse_unsigned(arg, argv[++i]));
+                region.y0 = static_cast<std::uint32_t>(parse_unsigned(arg, argv[++i]));
+                region.x1 = static_cast<std::uint32_t>(parse_unsigned(arg, argv[++i]));
+                region.y1 = static_cast<std::uint32_t>(parse_unsigned(arg, argv[++i]));
+            }
+            else if (arg == "-tiles" && i + 1 < argc) {
+                tiles = argv[++i];
+            }
+            else if (arg == "-sample-split" && i + 1 < argc) {
+                sample_split = argv[++i];
+            }
+            else if (arg == "-farm-tiles" && i + 1 < argc) {
+                farm.tiles = static_cast<std::uint32_t>(parse_unsigned(arg, argv[++i]));
+            }
+            else if (arg == "-farm-slices" && i + 1 < argc) {
+                farm.slices = static_cast<std::uint32_t>(parse_unsigned(arg, argv[++i]));
+            }
+            else if (arg == "-task-timeout" && i + 1 < argc) {
+                farm.task_timeout = parse_seconds(arg, argv[++i]);
+            }
+            else if (arg == "-local-workers" && i + 1 < argc) {
+                local_workers = static_cast<std::uint32_t>(parse_unsigned(arg, argv[++i]));
+            }
+            else if (arg == "-bvh-cache" && i + 1 < argc) {
+                bvh_cache = argv[++i];
+            }
+            else if (arg == "-aov" && i + 1 < argc) {
+                aov_names = argv[++i];
+            }
+            else if (arg == "-denoise") {
+                denoise = true;
+            }
+            else if (arg == "-affinity") {
+                affinity = true;
+            }
+            else if (arg == "-numa-replicas") {
+                numa_replicas = true;
+            }
+            else if (arg == "-binary") {
+                binary_scene = true;
+            }
+            else if (arg == "-wavefront") {
+                wavefront = true;
+            }
+            else if (arg == "-packets" && i + 1 < argc) {
+                packet_width = parse_unsigned(arg, argv[++i]);
+            }
+            else if (arg == "-heatmap") {
+                heatmap = true;
+                heatmap_metric = engine::COST_METRIC::Cycles;
+            }
+            else if (arg == "-heatmap-rays") {
+                heatmap = true;
+                heatmap_metric = engine::COST_METRIC::Rays;
+            }
+            else if (arg == "-isa" && i + 1 < argc) {
+                isa = argv[++i];
+            }
+            else if (arg == "-lights" && i + 1 < argc) {
+                std::string mode(argv[++i]);
+                if (mode == "uniform") {
+                    light_sampling = engine::LIGHT_SAMPLING::Uniform;
+                }
+                else if (mode == "tree") {
+                    light_sampling = engine::LIGHT_SAMPLING::Tree;
+                }
+                else if (mode == "power") {
+                    light_sampling = engine::LIGHT_SAMPLING::Power;
+                }
+                else {
+                    std::cout << "Unknown light sampling: " << mode << '\n';
+                    return EXIT_FAILURE;
+                }
             }
             else {
                 std::cout << "Unknown argument: " << argv[i] << '\n';
                 return EXIT_FAILURE;
             }
         }
-    }
 
-    try {
-        engine::Scene scene = engine::io::load_scene(std::string(argv[1]));
+        if (!isa.empty()) {
+            engine::select_kernels(engine::parse_isa(isa));
+        }
+        if (verbose) {
+            std::cout << "ISA: " << engine::isa_name(engine::kernels().isa) << " (detected "
+                      << engine::isa_name(engine::detect_isa()) << ")\n";
+        }
+        if (!trace_path.empty()) {
+            engine::trace::Tracer::get_instance().enable();
+        }
+
+        engine::RenderOptions options;
+        options.integrator = wavefront ? engine::INTEGRATOR::Wavefront : engine::INTEGRATOR::Recursive;
+        options.packet_width = packet_width;
+        options.samples = samples;
+        options.seed = seed;
+        options.denoise = denoise;
+
+        if (split) {
+            if (!sample_split.empty()) {
+                throw std::runtime_error("--split picks the sample slices itself.");
+            }
+            const std::uint32_t count = static_cast<std::uint32_t>(parse_unsigned("--split", argv[2]));
+            if (count == 0) {
+                throw std::runtime_error("--split needs at least one process.");
+            }
+            render_split(argv[0], count, argv[3], argv[4], std::vector<std::string>(argv + 5, argv + argc));
+            if (verbose) {
+                std::cout << count << " processes merged into " << argv[4] << '\n';
+            }
+            if (!trace_path.empty()) {
+                engine::trace::Tracer::get_instance().write(trace_path);
+            }
+            return EXIT_SUCCESS;
+        }
+
+        if (coordinate) {
+            if (heatmap || denoise || sequence || !aov_names.empty() || !tiles.empty() || !region.empty() ||
+                !sample_split.empty()) {
+                throw std::runtime_error("--coordinate does not support heatmaps, denoising, sequences, AOVs or "
+                                         "partial images.");
+            }
+            std::tie(farm.address, farm.port) = parse_endpoint(argv[2], farm.address);
+            farm.verbose = verbose;
+            if (farm.slices > 1 && !options.seed.has_value()) {
+                // Sample slices must draw from the same streams on every worker.
+                options.seed = std::random_device{}();
+            }
+            engine::Scene scene = [&] {
+                engine::trace::Span span("load_scene");
+                return engine::load_scene(std::string(argv[3]), light_sampling, bvh_cache);
+            }();
+            std::vector<int> children;
+            auto start_workers = [&](std::uint16_t port) {
+                for (std::uint32_t i = 0; i < local_workers; ++i) {
+                    children.push_back(engine::shard::start_process(
+                        {argv[0], "--worker", "127.0.0.1:" + std::to_string(port), "-threads",
+                         std::to_string(threads.value_or(1))}));
+                }
+            };
+            engine::shard::Partial image;
+            try {
+                image = engine::farm::coordinate(scene, options, light_sampling, farm, start_workers);
+            }
+            catch (const std::exception&) {
+                engine::shard::wait_processes(children, std::chrono::milliseconds(0));
+                throw;
+            }
+            // Workers exit once told the frame is done; hung ones are killed.
+            engine::shard::wait_processes(children, std::chrono::seconds(2));
+            write_merged(argv[4], image);
+            if (!trace_path.empty()) {
+                engine::trace::Tracer::get_instance().write(trace_path);
+            }
+            return EXIT_SUCCESS;
+        }
+
+        if (client) {
+            std::ifstream in(argv[3], std::ios::binary);
+            if (!in.is_open()) {
+                throw std::runtime_error("Bad path to scene file.");
+            }
+            std::ostringstream bytes;
+            if (binary_scene) {
+                engine::io::write_binary_scene(bytes, engine::io::parse_scene(in, light_sampling));
+            }
+            else {
+                bytes << in.rdbuf();
+            }
+            engine::server::ClientResult result = engine::server::request(argv[2], bytes.str(), options, light_sampling);
+            engine::io::write_image(argv[4], result.width, result.height, result.image);
+            if (verbose) {
+                std::cout << result.width << 'x' << result.height << (result.cached ? " from cached scene\n" : "\n");
+            }
+            return EXIT_SUCCESS;
+        }
+
+        engine::Renderer renderer(threads.value_or(batch || serve || worker ? 0 : 1), affinity);
+        options.pool = &renderer.pool();
+        if (worker) {
+            auto [host, port] = parse_endpoint(argv[2], "127.0.0.1");
+            engine::farm::work(host, port, renderer, bvh_cache, verbose);
+            if (!trace_path.empty()) {
+                engine::trace::Tracer::get_instance().write(trace_path);
+            }
+            return EXIT_SUCCESS;
+        }
+        if (serve) {
+            engine::server::serve(argv[2], renderer, 16, verbose);
+            return EXIT_SUCCESS;
+        }
+
+        if (batch) {
+            if (heatmap) {
+                throw std::runtime_error("Heatmaps are not supported in batch mode.");
+            }
+            std::vector<engine::batch::Job> jobs = engine::batch::read_manifest(argv[2]);
+            std::size_t failed = engine::batch::render(jobs, light_sampling, options, bvh_cache);
+            if (verbose) {
+                std::cout << jobs.size() - failed << " of " << jobs.size() << " scenes rendered on "
+                          << renderer.threads() << " threads\n";
+            }
+            if (!trace_path.empty()) {
+                engine::trace::Tracer::get_instance().write(trace_path);
+            }
+            return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        engine::Scene scene = [&] {
+            engine::trace::Span span("load_scene");
+            return engine::load_scene(std::string(argv[1]), light_sampling, bvh_cache);
+        }();
         if (verbose) {
             std::cout << scene << '\n';
         }
-        engine::Image image = engine::generate_image(scene, multithread);
-        engine::io::write_image(std::string(argv[2]), scene.width, scene.height, image);
+        if (numa_replicas && !sequence) {
+            renderer.replicate(scene);
+        }
+        if (sequence) {
+            if (heatmap) {
+                throw std::runtime_error("Heatmaps are not supported for sequences.");
+            }
+            engine::sequence::render(scene, argv[2], options, 0, 0, [](std::uint32_t frame) {
+                if (verbose) {
+                    std::cout << "frame " << frame << " done\n";
+                }
+            });
+            if (!trace_path.empty()) {
+                engine::trace::Tracer::get_instance().write(trace_path);
+            }
+            return EXIT_SUCCESS;
+        }
+        const bool partial = !tiles.empty() || !region.empty() || !sample_split.empty();
+        engine::Accumulation accumulation;
+        std::uint32_t total_samples = 0;
+        if (partial) {
+            if (heatmap || denoise) {
+                throw std::runtime_error("Heatmaps and denoising are not supported for partial images.");
+            }
+            if (!sample_split.empty()) {
+                if (!aov_names.empty()) {
+                    throw std::runtime_error("AOVs are not supported for sample slices.");
+                }
+                auto [index, count] = engine::shard::parse_tile(sample_split);
+                total_samples = samples != 0 ? samples : scene.samples;
+                std::tie(accumulation.first, accumulation.last) =
+                    engine::shard::sample_slice(total_samples, index, count);
+                options.accumulation = &accumulation;
+            }
+            if (!tiles.empty()) {
+                auto [index, count] = engine::shard::parse_tile(tiles);
+                region = engine::shard::tile_region(scene.width, scene.height, index, count);
+            }
+            options.region = region;
+        }
+        engine::CostMap cost_map;
+        if (heatmap) {
+            options.cost_map = &cost_map;
+            options.cost_metric = heatmap_metric;
+        }
+
+        engine::Aovs aovs;
+        std::stringstream names(aov_names);
+        for (std::string name; std::getline(names, name, ',');) {
+            if (name == "all") {
+                for (engine::AOV aov : engine::all_aovs) {
+                    aovs.enable(aov);
+                }
+            }
+            else {
+                aovs.enable(engine::parse_aov(name));
+            }
+        }
+        if (aovs.enabled != 0) {
+            options.aovs = &aovs;
+        }
+        const engine::Region rendered = engine::resolve_region(scene, options);
+        if (partial) {
+            engine::shard::Partial result{scene.width, scene.height, rendered, engine::HdrImage(rendered.size())};
+            renderer.render(scene, options, reinterpret_cast<float*>(result.radiance.data()));
+            engine::trace::Span span("write_partial");
+            if (options.accumulation != nullptr) {
+                engine::HdrImage().swap(result.radiance);
+                engine::shard::write_samples(std::string(argv[2]),
+                                             engine::shard::Samples{scene.width, scene.height, rendered, total_samples,
+                                                                    std::move(accumulation)});
+            }
+            else {
+                engine::shard::write_partial(std::string(argv[2]), result);
+            }
+        }
+        else {
+            engine::Image image(rendered.size() * 3);
+            renderer.render(scene, options, image.data());
+            engine::trace::Span span("write_image");
+            engine::io::write_image(std::string(argv[2]), scene.width, scene.height, image);
+            if (heatmap) {
+                engine::io::write_heatmap(heatmap_path(argv[2]), scene.width, scene.height, cost_map);
+            }
+        }
+        if (aovs.enabled != 0) {
+            const std::string image_path(argv[2]);
+            engine::io::write_aovs([&](engine::AOV aov) { return aov_path(image_path, aov); }, rendered.width(),
+                                   rendered.height(), aovs);
+        }
+
+        if (!trace_path.empty()) {
+            engine::trace::Tracer::get_instance().write(trace_path);
+        }
     }
-    catch (const std::runtime_error& e) {
+    catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
         return EXIT_FAILURE;
     }
@@ -0,0 +1,417 @@
+#include "mesh.hpp"
+#include "glm/geometric.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace engine {
+
+namespace {
+
+std::uint32_t vertex_index(long long index, std::size_t vertices) {
+    // OBJ indices start at 1; negative ones count back from the last vertex read so far.
+    long long resolved = index < 0 ? static_cast<long long>(vertices) + index : index - 1;
+    if (index == 0 || resolved < 0 || resolved >= static_cast<long long>(vertices)) {
+        throw std::runtime_error("Mesh face refers to a missing vertex.");
+    }
+    return static_cast<std::uint32_t>(resolved);
+}
+
+// The leading integer of "12", "12/4" or "12//7"; throws on anything else.
+long long parse_obj_index(const std::string& corner, const std::string& line) {
+    const std::string text = corner.substr(0, corner.find('/'));
+    long long index = 0;
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), index);
+    if (error != std::errc() || end != text.data() + text.size() || text.empty()) {
+        throw std::runtime_error("Bad OBJ face: " + line);
+    }
+    return index;
+}
+
+void load_obj(std::istream& in, MeshData& mesh) {
+    std::string line;
+    std::vector<std::uint32_t> face;
+    while (std::getline(in, line)) {
+        std::stringstream ss(line);
+        std::string command;
+        ss >> command;
+        if (command == "v") {
+            glm::vec3 vertex;
+            if (!(ss >> vertex.x >> vertex.y >> vertex.z)) {
+                throw std::runtime_error("Bad OBJ vertex: " + line);
+            }
+            mesh.vertices.push_back(vertex);
+        }
+        else if (command == "f") {
+            face.clear();
+            std::string corner;
+            while (ss >> corner) {
+                // "v", "v/vt", "v//vn" or "v/vt/vn": only the position is used.
+                face.push_back(vertex_index(parse_obj_index(corner, line), mesh.vertices.size()));
+            }
+            for (std::size_t i = 2; i < face.size(); ++i) {
+                mesh.indices.insert(mesh.indices.end(), {face[0], face[i - 1], face[i]});
+            }
+        }
+    }
+}
+
+enum class PLY_FORMAT { Ascii, LittleEndian, BigEndian };
+
+struct PlyProperty {
+    std::string name;
+    std::string type;
+    // Element count type of a list property, empty for scalars.
+    std::string count_type;
+};
+
+struct PlyElement {
+    std::string name;
+    std::size_t count;
+    std::vector<PlyProperty> properties;
+};
+
+std::size_t ply_type_size(const std::string& type) {
+    if (type == "char" || type == "uchar" || type == "int8" || type == "uint8") {
+        return 1;
+    }
+    if (type == "short" || type == "ushort" || type == "int16" || type == "uint16") {
+        return 2;
+    }
+    if (type == "int" || type == "uint" || type == "float" || type == "int32" || type == "uint32" ||
+        type == "float32") {
+        return 4;
+    }
+    if (type == "double" || type == "float64") {
+        return 8;
+    }
+    throw std::runtime_error("Unknown PLY property type " + type + ".");
+}
+
+template <typename T>
+double decode(const unsigned char* bytes) {
+    T value;
+    std::memcpy(&value, bytes, sizeof(T));
+    return static_cast<double>(value);
+}
+
+double read_ply_value(std::istream& in, PLY_FORMAT format, const std::string& type) {
+    if (format == PLY_FORMAT::Ascii) {
+        double value;
+        if (!(in >> value)) {
+            throw std::runtime_error("PLY file is truncated.");
+        }
+        return value;
+    }
+    std::array<unsigned char, 8> bytes{};
+    const std::size_t size = ply_type_size(type);
+    if (!in.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(size))) {
+        throw std::runtime_error("PLY file is truncated.");
+    }
+    const bool native = (format == PLY_FORMAT::LittleEndian) == (std::endian::native == std::endian::little);
+    if (!native) {
+        std::reverse(bytes.begin(), bytes.begin() + size);
+    }
+    if (type == "char" || type == "int8") {
+        return decode<std::int8_t>(bytes.data());
+    }
+    if (type == "uchar" || type == "uint8") {
+        return decode<std::uint8_t>(bytes.data());
+    }
+    if (type == "short" || type == "int16") {
+        return decode<std::int16_t>(bytes.data());
+    }
+    if (type == "ushort" || type == "uint16") {
+        return decode<std::uint16_t>(bytes.data());
+    }
+    if (type == "int" || type == "int32") {
+        return decode<std::int32_t>(bytes.data());
+    }
+    if (type == "uint" || type == "uint32") {
+        return decode<std::uint32_t>(bytes.data());
+    }
+    if (type == "float" || type == "float32") {
+        return decode<float>(bytes.data());
+    }
+    return decode<double>(bytes.data());
+}
+
+void load_ply(std::istream& in, MeshData& mesh) {
+    std::string line;
+    if (!std::getline(in, line) || line.rfind("ply", 0) != 0) {
+        throw std::runtime_error("Not a PLY file.");
+    }
+    PLY_FORMAT format = PLY_FORMAT::Ascii;
+    std::vector<PlyElement> elements;
+    while (std::getline(in, line)) {
+        std::stringstream ss(line);
+        std::string keyword;
+        ss >> keyword;
+        if (keyword == "format") {
+            std::string name;
+            ss >> name;
+            if (name != "ascii" && name != "binary_little_endian" && name != "binary_big_endian") {
+                throw std::runtime_error("Bad PLY format: " + line);
+            }
+            format = name == "binary_little_endian" ? PLY_FORMAT::LittleEndian
+                     : name == "binary_big_endian"  ? PLY_FORMAT::BigEndian
+                                                    : PLY_FORMAT::Ascii;
+        }
+        else if (keyword == "element") {
+            PlyElement element;
+            long long count = -1;
+            if (!(ss >> element.name >> count) || count < 0) {
+                throw std::runtime_error("Bad PLY element: " + line);
+            }
+            element.count = static_cast<std::size_t>(count);
+            elements.push_back(element);
+        }
+        else if (keyword == "property") {
+            if (elements.empty()) {
+                throw std::runtime_error("PLY property outside of an element.");
+            }
+            PlyProperty property;
+            ss >> property.type;
+            if (property.type == "list") {
+                ss >> property.count_type >> property.type;
+            }
+            if (!(ss >> property.name)) {
+                throw std::runtime_error("Bad PLY property: " + line);
+            }
+            ply_type_size(property.type);
+            if (!property.count_type.empty()) {
+                ply_type_size(property.count_type);
+            }
+            elements.back().properties.push_back(property);
+        }
+        else if (keyword == "end_header") {
+            break;
+        }
+    }
+
+    std::vector<std::uint32_t> face;
+    for (const PlyElement& element : elements) {
+        for (std::size_t i = 0; i < element.count; ++i) {
+            glm::vec3 vertex{};
+            face.clear();
+            for (const PlyProperty& property : element.properties) {
+                if (!property.count_type.empty()) {
+                    double length = read_ply_value(in, format, property.count_type);
+                    if (!(length >= 0.0)) {
+                        throw std::runtime_error("Bad PLY list length.");
+                    }
+                    auto count = static_cast<std::size_t>(length);
+                    for (std::size_t k = 0; k < count; ++k) {
+                        double value = read_ply_value(in, format, property.type);
+                        if (property.name == "vertex_indices" || property.name == "vertex_index") {
+                            if (!(value >= 0.0 && value < 4294967296.0)) {
+                                throw std::runtime_error("Bad PLY vertex index.");
+                            }
+                            face.push_back(static_cast<std::uint32_t>(value));
+                        }
+                    }
+                    continue;
+                }
+                double value = read_ply_value(in, format, property.type);
+                if (element.name == "vertex" && property.name.size() == 1 && property.name[0] >= 'x' &&
+                    property.name[0] <= 'z') {
+                    vertex[property.name[0] - 'x'] = static_cast<float>(value);
+                }
+            }
+            if (element.name == "vertex") {
+                mesh.vertices.push_back(vertex);
+            }
+            else if (element.name == "face") {
+                for (std::size_t k = 2; k < face.size(); ++k) {
+                    mesh.indices.insert(mesh.indices.end(), {face[0], face[k - 1], face[k]});
+                }
+            }
+        }
+    }
+    for (std::uint32_t index : mesh.indices) {
+        if (index >= mesh.vertices.size()) {
+            throw std::runtime_error("Mesh face refers to a missing vertex.");
+        }
+    }
+}
+
+// Per-ray setup of the watertight test: the ray is sheared so it runs along +z from the origin.
+struct Shear {
+    int kx;
+    int ky;
+    int kz;
+    float sx;
+    float sy;
+    float sz;
+};
+
+Shear make_shear(glm::vec3 direction) {
+    glm::vec3 abs_direction = glm::abs(direction);
+    Shear shear{};
+    shear.kz = abs_direction.x > abs_direction.y ? (abs_direction.x > abs_direction.z ? 0 : 2)
+                                                 : (abs_direction.y > abs_direction.z ? 1 : 2);
+    shear.kx = (shear.kz + 1) % 3;
+    shear.ky = (shear.kx + 1) % 3;
+    if (direction[shear.kz] < 0.f) {
+        std::swap(shear.kx, shear.ky);
+    }
+    shear.sx = direction[shear.kx] / direction[shear.kz];
+    shear.sy = direction[shear.ky] / direction[shear.kz];
+    shear.sz = 1.f / direction[shear.kz];
+    return shear;
+}
+
+// Distance to the triangle along the ray, if hit closer than t_max.
+std::optional<float> intersect_triangle(
+    const Shear& shear, glm::vec3 start, glm::vec3 a, glm::vec3 b, glm::vec3 c, float t_max) {
+    a -= start;
+    b -= start;
+    c -= start;
+    const float ax = a[shear.kx] - shear.sx * a[shear.kz];
+    const float ay = a[shear.ky] - shear.sy * a[shear.kz];
+    const float bx = b[shear.kx] - shear.sx * b[shear.kz];
+    const float by = b[shear.ky] - shear.sy * b[shear.kz];
+    const float cx = c[shear.kx] - shear.sx * c[shear.kz];
+    const float cy = c[shear.ky] - shear.sy * c[shear.kz];
+
+    float u = cx * by - cy * bx;
+    float v = ax * cy - ay * cx;
+    float w = bx * ay - by * ax;
+    if (u == 0.f || v == 0.f || w == 0.f) {
+        // On an edge in single precision: decide in double so neighbouring triangles agree.
+        u = static_cast<float>(static_cast<double>(cx) * by - static_cast<double>(cy) * bx);
+        v = static_cast<float>(static_cast<double>(ax) * cy - static_cast<double>(ay) * cx);
+        w = static_cast<float>(static_cast<double>(bx) * ay - static_cast<double>(by) * ax);
+    }
+    if ((u < 0.f || v < 0.f || w < 0.f) && (u > 0.f || v > 0.f || w > 0.f)) {
+        return std::nullopt;
+    }
+    const float det = u + v + w;
+    if (det == 0.f) {
+        return std::nullopt;
+    }
+    const float t_scaled =
+        u * shear.sz * a[shear.kz] + v * shear.sz * b[shear.kz] + w * shear.sz * c[shear.kz];
+    const float t = t_scaled / det;
+    if (!(t > 0.f) || t >= t_max) {
+        return std::nullopt;
+    }
+    return t;
+}
+
+} // namespace
+
+std::size_t MeshData::triangle_count() const {
+    return indices.size() / 3;
+}
+
+void MeshData::prepare() {
+    std::vector<Aabb> triangle_bounds(triangle_count());
+    std::vector<float> areas(triangle_count());
+    bounds = Aabb{};
+    area = 0.f;
+    for (std::size_t i = 0; i < triangle_count(); ++i) {
+        const glm::vec3& a = vertices[indices[3 * i]];
+        const glm::vec3& b = vertices[indices[3 * i + 1]];
+        const glm::vec3& c = vertices[indices[3 * i + 2]];
+        triangle_bounds[i].extend(a);
+        triangle_bounds[i].extend(b);
+        triangle_bounds[i].extend(c);
+        bounds.extend(triangle_bounds[i]);
+        areas[i] = 0.5f * glm::length(glm::cross(b - a, c - a));
+        area += areas[i];
+    }
+    if (triangle_count() == 0 || area <= 0.f) {
+        throw std::runtime_error("Mesh has no triangles.");
+    }
+    bvh.build(triangle_bounds);
+    triangles.build(areas);
+}
+
+std::shared_ptr<MeshData> load_mesh(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        throw std::runtime_error("Bad path to mesh file " + path + ".");
+    }
+    auto mesh = std::make_shared<MeshData>();
+    std::string extension = path.substr(path.find_last_of('.') + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (extension == "obj") {
+        load_obj(in, *mesh);
+    }
+    else if (extension == "ply") {
+        load_ply(in, *mesh);
+    }
+    else {
+        throw std::runtime_error("Unknown mesh format " + path + ".");
+    }
+    mesh->prepare();
+    return mesh;
+}
+
+std::optional<MeshHit> intersect_mesh(const MeshData& mesh, glm::vec3 start, glm::vec3 direction) {
+    const Shear shear = make_shear(direction);
+    const glm::vec3 inv_direction = 1.f / direction;
+    std::optional<MeshHit> closest;
+    float t_max = std::numeric_limits<float>::infinity();
+
+    std::array<std::uint32_t, Bvh::max_depth + 1> stack;
+    std::size_t stack_size = 0;
+    stack[stack_size++] = 0;
+    while (stack_size > 0) {
+        const BvhNode& node = mesh.bvh.nodes[stack[--stack_size]];
+        glm::vec3 t_1 = (node.bounds.min - start) * inv_direction;
+        glm::vec3 t_2 = (node.bounds.max - start) * inv_direction;
+        glm::vec3 t_near = glm::min(t_1, t_2);
+        glm::vec3 t_far = glm::max(t_1, t_2);
+        float t_enter = std::max(std::max(t_near.x, t_near.y), std::max(t_near.z, 0.f));
+        float t_exit = std::min(std::min(t_far.x, t_far.y), std::min(t_far.z, t_max));
+        if (t_enter > t_exit) {
+            continue;
+        }
+        if (node.count == 0) {
+            std::uint32_t node_index = static_cast<std::uint32_t>(&node - mesh.bvh.nodes.data());
+            stack[stack_size++] = node.offset;
+            stack[stack_size++] = node_index + 1;
+            continue;
+        }
+        for (std::uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+            std::uint32_t triangle = mesh.bvh.indices[i];
+            auto t = intersect_triangle(shear, start, mesh.vertices[mesh.indices[3 * triangle]],
+                                        mesh.vertices[mesh.indices[3 * triangle + 1]],
+                                        mesh.vertices[mesh.indices[3 * triangle + 2]], t_max);
+            if (t.has_value()) {
+                t_max = t.value();
+                closest = MeshHit{t_max, triangle};
+            }
+        }
+    }
+    return closest;
+}
+
+glm::vec3 triangle_normal(const MeshData& mesh, std::uint32_t triangle) {
+    const glm::vec3& a = mesh.vertices[mesh.indices[3 * triangle]];
+    const glm::vec3& b = mesh.vertices[mesh.indices[3 * triangle + 1]];
+    const glm::vec3& c = mesh.vertices[mesh.indices[3 * triangle + 2]];
+    return glm::normalize(glm::cross(b - a, c - a));
+}
+
+glm::vec3 sample_mesh(const MeshData& mesh, float u1, float u2, float u3, float u4) {
+    std::uint32_t triangle = mesh.triangles.sample(u1, u2);
+    const glm::vec3& a = mesh.vertices[mesh.indices[3 * triangle]];
+    const glm::vec3& b = mesh.vertices[mesh.indices[3 * triangle + 1]];
+    const glm::vec3& c = mesh.vertices[mesh.indices[3 * triangle + 2]];
+    float s = std::sqrt(u3);
+    return (1.f - s) * a + s * (1.f - u4) * b + s * u4 * c;
+}
+
+} // namespace engine
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "alias.hpp"
+#include "bvh.hpp"
+#include "glm/vec3.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace engine {
+
+// Triangles of one mesh file in object space, shared by every MESH primitive that loads the file.
+struct MeshData {
+    std::vector<glm::vec3> vertices;
+    // Three vertex indices per triangle.
+    std::vector<std::uint32_t> indices;
+    // BVH over the triangles: Bvh::indices holds triangle numbers.
+    Bvh bvh;
+    Aabb bounds;
+    float area = 0.f;
+    // Triangles weighted by area, to sample points uniformly on the surface.
+    rand::AliasTable triangles;
+
+    std::size_t triangle_count() const;
+    // Builds the BVH, bounds, area and sampling table from vertices and indices.
+    void prepare();
+};
+
+// Wavefront OBJ ("v" and "f" lines, polygons are split into fans) or PLY (binary of either byte order, or ascii;
+// vertex x y z and face vertex_indices), told apart by the extension. Returns a prepared mesh.
+std::shared_ptr<MeshData> load_mesh(const std::string& path);
+
+struct MeshHit {
+    float t;
+    std::uint32_t triangle;
+};
+
+// Closest triangle hit with t > 0, in the object space of the mesh. The test is watertight (Woop, Benthin and Wald):
+// a ray through a shared edge or vertex hits one of the triangles around it and never slips between them.
+std::optional<MeshHit> intersect_mesh(const MeshData& mesh, glm::vec3 start, glm::vec3 direction);
+// Unit geometric normal, following the winding order.
+glm::vec3 triangle_normal(const MeshData& mesh, std::uint32_t triangle);
+// Point distributed uniformly over the surface, from four uniform numbers in [0, 1).
+glm::vec3 sample_mesh(const MeshData& mesh, float u1, float u2, float u3, float u4);
+
+} // namespace engine
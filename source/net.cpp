@@ -0,0 +1,128 @@
+#include "net.hpp"
+
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace engine::net {
+
+Socket::~Socket() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+Socket::Socket(Socket&& other) noexcept : fd(std::exchange(other.fd, -1)) {}
+
+Socket& Socket::operator=(Socket&& other) noexcept {
+    if (this != &other) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        fd = std::exchange(other.fd, -1);
+    }
+    return *this;
+}
+
+void write_all(int fd, const void* data, std::size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t written = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (written <= 0) {
+            throw std::runtime_error("Connection closed while sending.");
+        }
+        bytes += written;
+        size -= static_cast<std::size_t>(written);
+    }
+}
+
+bool read_all(int fd, void* data, std::size_t size) {
+    char* bytes = static_cast<char*>(data);
+    std::size_t total = size;
+    while (size > 0) {
+        ssize_t got = recv(fd, bytes, size, 0);
+        if (got == 0 && size == total) {
+            return false;
+        }
+        if (got <= 0) {
+            throw std::runtime_error("Connection closed while receiving.");
+        }
+        bytes += got;
+        size -= static_cast<std::size_t>(got);
+    }
+    return true;
+}
+
+Socket listen_tcp(const std::string& address, std::uint16_t port) {
+    sockaddr_in local{};
+    local.sin_family = AF_INET;
+    local.sin_port = htons(port);
+    if (inet_pton(AF_INET, address.c_str(), &local.sin_addr) != 1) {
+        throw std::runtime_error("Bad IPv4 address: " + address);
+    }
+    Socket listener(socket(AF_INET, SOCK_STREAM, 0));
+    if (listener.get() < 0) {
+        throw std::runtime_error("Failed to create socket.");
+    }
+    int reuse = 1;
+    setsockopt(listener.get(), SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(listener.get(), reinterpret_cast<const sockaddr*>(&local), sizeof(local)) != 0 ||
+        listen(listener.get(), 64) != 0) {
+        throw std::runtime_error("Failed to listen on " + address + ':' + std::to_string(port));
+    }
+    return listener;
+}
+
+std::uint16_t local_port(const Socket& socket) {
+    sockaddr_in local{};
+    socklen_t size = sizeof(local);
+    if (getsockname(socket.get(), reinterpret_cast<sockaddr*>(&local), &size) != 0) {
+        throw std::runtime_error("Failed to query the socket address.");
+    }
+    return ntohs(local.sin_port);
+}
+
+Socket connect_tcp(const std::string& host, std::uint16_t port, std::uint32_t attempts) {
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* found = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &found) != 0 || found == nullptr) {
+        throw std::runtime_error("Unknown host: " + host);
+    }
+    std::unique_ptr<addrinfo, decltype(&freeaddrinfo)> addresses(found, freeaddrinfo);
+    for (std::uint32_t attempt = 0; attempt < attempts; ++attempt) {
+        if (attempt > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        Socket connection(socket(AF_INET, SOCK_STREAM, 0));
+        if (connection.get() < 0) {
+            throw std::runtime_error("Failed to create socket.");
+        }
+        if (connect(connection.get(), found->ai_addr, found->ai_addrlen) == 0) {
+            int nodelay = 1;
+            setsockopt(connection.get(), IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+            return connection;
+        }
+    }
+    throw std::runtime_error("Failed to connect to " + host + ':' + std::to_string(port));
+}
+
+void set_timeout(const Socket& socket, double seconds) {
+    timeval timeout{};
+    timeout.tv_sec = static_cast<time_t>(seconds);
+    timeout.tv_usec = static_cast<suseconds_t>((seconds - static_cast<double>(timeout.tv_sec)) * 1e6);
+    setsockopt(socket.get(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(socket.get(), SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+} // namespace engine::net
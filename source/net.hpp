@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace engine::net {
+
+// Owns a socket descriptor.
+class Socket {
+public:
+    explicit Socket(int fd = -1) : fd(fd) {}
+    ~Socket();
+    Socket(Socket&& other) noexcept;
+    Socket& operator=(Socket&& other) noexcept;
+    Socket(const Socket&) = delete;
+    Socket& operator=(const Socket&) = delete;
+
+    int get() const {
+        return fd;
+    }
+
+private:
+    int fd;
+};
+
+void write_all(int fd, const void* data, std::size_t size);
+// False on a clean end of stream before the first byte, throws if the stream ends in the middle.
+bool read_all(int fd, void* data, std::size_t size);
+
+// TCP socket listening on the IPv4 address and port; port 0 picks a free one, see local_port.
+Socket listen_tcp(const std::string& address, std::uint16_t port);
+std::uint16_t local_port(const Socket& socket);
+// Connects to a TCP port, retrying for `attempts` tries 100 ms apart while nothing listens there yet.
+Socket connect_tcp(const std::string& host, std::uint16_t port, std::uint32_t attempts = 1);
+// Send and receive calls on the socket fail after `seconds` without progress.
+void set_timeout(const Socket& socket, double seconds);
+
+} // namespace engine::net
@@ -0,0 +1,145 @@
+#include "numa.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <pthread.h>
+#include <sched.h>
+
+namespace engine::numa {
+
+namespace {
+
+// "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}
+std::vector<int> parse_cpu_list(const std::string& text) {
+    std::vector<int> cpus;
+    std::stringstream ranges(text);
+    for (std::string range; std::getline(ranges, range, ',');) {
+        if (range.empty() || range == "\n") {
+            continue;
+        }
+        std::size_t dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+std::vector<int> allowed_cpus() {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    std::vector<int> cpus;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    if (cpus.empty()) {
+        cpus.push_back(0);
+    }
+    return cpus;
+}
+
+struct Layout {
+    Topology topology;
+    // Index of each CPU's node in topology.nodes.
+    std::vector<std::size_t> node_of_cpu;
+};
+
+Layout detect() {
+    const std::vector<int> allowed = allowed_cpus();
+    std::vector<std::pair<int, std::vector<int>>> found;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator("/sys/devices/system/node", error)) {
+        const std::string name = entry.path().filename().string();
+        if (name.size() <= 4 || name.compare(0, 4, "node") != 0 ||
+            !std::all_of(name.begin() + 4, name.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+            continue;
+        }
+        std::ifstream in(entry.path() / "cpulist");
+        std::string list;
+        std::getline(in, list);
+        std::vector<int> cpus;
+        for (int cpu : parse_cpu_list(list)) {
+            if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end()) {
+                cpus.push_back(cpu);
+            }
+        }
+        if (!cpus.empty()) {
+            found.emplace_back(std::stoi(name.substr(4)), std::move(cpus));
+        }
+    }
+    std::sort(found.begin(), found.end());
+
+    Layout layout;
+    for (auto& [_, cpus] : found) {
+        layout.topology.nodes.push_back(std::move(cpus));
+    }
+    if (layout.topology.nodes.empty()) {
+        layout.topology.nodes.push_back(allowed);
+    }
+    for (std::size_t node = 0; node < layout.topology.nodes.size(); ++node) {
+        for (int cpu : layout.topology.nodes[node]) {
+            if (static_cast<std::size_t>(cpu) >= layout.node_of_cpu.size()) {
+                layout.node_of_cpu.resize(cpu + 1, 0);
+            }
+            layout.node_of_cpu[cpu] = node;
+        }
+    }
+    return layout;
+}
+
+const Layout& layout() {
+    static const Layout detected = detect();
+    return detected;
+}
+
+} // namespace
+
+const Topology& topology() {
+    return layout().topology;
+}
+
+std::size_t current_node() {
+    const std::vector<std::size_t>& node_of_cpu = layout().node_of_cpu;
+    int cpu = sched_getcpu();
+    return cpu >= 0 && static_cast<std::size_t>(cpu) < node_of_cpu.size() ? node_of_cpu[cpu] : 0;
+}
+
+std::vector<int> spread_cpus(std::size_t count) {
+    const std::vector<std::vector<int>>& nodes = topology().nodes;
+    std::vector<int> order;
+    for (std::size_t i = 0; order.size() < count; ++i) {
+        bool any = false;
+        for (const std::vector<int>& cpus : nodes) {
+            if (i < cpus.size()) {
+                order.push_back(cpus[i]);
+                any = true;
+            }
+        }
+        if (!any) {
+            i = static_cast<std::size_t>(-1);
+        }
+    }
+    order.resize(count);
+    return order;
+}
+
+bool pin_thread(const std::vector<int>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+} // namespace engine::numa
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace engine::numa {
+
+// CPUs the process may run on, grouped by NUMA node (from /sys/devices/system/node). Nodes without such CPUs are left
+// out, so restricting the process with taskset or numactl restricts the topology too. Without NUMA information all
+// CPUs form one node.
+struct Topology {
+    std::vector<std::vector<int>> nodes;
+};
+
+const Topology& topology();
+// Index into topology().nodes of the node the calling thread runs on right now; 0 if unknown.
+std::size_t current_node();
+// `count` CPUs taken from every node in turn (node 0's first CPU, node 1's first CPU, ..., node 0's second CPU, ...),
+// so threads pinned to them spread evenly over the nodes. Starts over once every CPU is taken.
+std::vector<int> spread_cpus(std::size_t count);
+// Restricts the calling thread to the CPUs; false if the system refused.
+bool pin_thread(const std::vector<int>& cpus);
+
+} // namespace engine::numa
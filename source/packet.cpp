@@ -0,0 +1,66 @@
+#include "packet.hpp"
+#include "kernels.hpp"
+#include "ray.hpp"
+
+#include <array>
+
+namespace engine::packet {
+
+namespace {
+
+PacketScene packet_scene(const Scene& scene) {
+    return PacketScene{scene.bvh.nodes.data(),     scene.bvh.nodes.size(),     scene.bvh.indices.data(),
+                       scene.bvh.unbounded.data(), scene.bvh.unbounded.size(), scene.flat.records.data()};
+}
+
+} // namespace
+
+template <std::size_t N>
+glm::vec3 trace_primary(const Scene& scene, std::pair<std::uint32_t, std::uint32_t> pixel_coord) {
+    std::array<ray::Ray, N> rays;
+    // Origins then directions, one component at a time: the SoA layout the kernels load.
+    alignas(32) float packet[6 * N];
+    for (std::size_t lane = 0; lane < N; ++lane) {
+        rays[lane] = ray::generate_ray(scene, pixel_coord);
+        for (int axis = 0; axis < 3; ++axis) {
+            packet[axis * N + lane] = rays[lane].start[axis];
+            packet[(axis + 3) * N + lane] = rays[lane].direction[axis];
+        }
+    }
+    if (scene.ray_depth == 0) {
+        return static_cast<float>(N) * scene.bg_color;
+    }
+
+    alignas(32) float t[N];
+    std::array<std::uint32_t, N> hit;
+    const Kernels& table = kernels();
+    if constexpr (N == 8) {
+        table.packet8_closest(packet_scene(scene), packet, t, hit.data());
+    }
+    else {
+        table.packet4_closest(packet_scene(scene), packet, t, hit.data());
+    }
+    ray::count_traced_rays(N);
+
+    glm::vec3 color{0.f, 0.f, 0.f};
+    for (std::size_t lane = 0; lane < N; ++lane) {
+        if (hit[lane] == FlatPrimitives::no_hit) {
+            color += scene.bg_color;
+            continue;
+        }
+        Shape* primitive = scene.primitives[hit[lane]];
+        auto inter = ray::intersection(rays[lane], primitive);
+        if (!inter.has_value()) {
+            // The packet kernel and the scalar test disagree on a grazing hit.
+            color += ray::raytrace(rays[lane], scene, 0).second;
+            continue;
+        }
+        color += ray::calc_color(scene, primitive, rays[lane], inter.value(), 0);
+    }
+    return color;
+}
+
+template glm::vec3 trace_primary<4>(const Scene&, std::pair<std::uint32_t, std::uint32_t>);
+template glm::vec3 trace_primary<8>(const Scene&, std::pair<std::uint32_t, std::uint32_t>);
+
+} // namespace engine::packet
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "scene.hpp"
+
+#include <cstdint>
+#include <utility>
+
+namespace engine::packet {
+
+// Traces N camera samples of the pixel as one packet and returns the sum of their colors.
+// Only primary visibility is packetized: the packet goes through the SIMD kernels of the selected ISA (kernels.hpp),
+// shading and secondary bounces continue with single rays.
+template <std::size_t N>
+glm::vec3 trace_primary(const Scene& scene, std::pair<std::uint32_t, std::uint32_t> pixel_coord);
+
+} // namespace engine::packet
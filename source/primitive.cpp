@@ -11,6 +11,20 @@ Shape::Shape(PRIMITIVE_TYPE type)
       emission(0.f, 0.f, 0.f),
       ior(1.f) {}
 
+glm::vec3 Shape::position_at(float time) const {
+    if (!motion.has_value()) {
+        return position;
+    }
+    return position + time * motion->translation;
+}
+
+glm::quat Shape::rotation_at(float time) const {
+    if (!motion.has_value()) {
+        return rotation;
+    }
+    return glm::normalize(glm::slerp(glm::quat{1.f, 0.f, 0.f, 0.f}, motion->rotation, time) * rotation);
+}
+
 Plane::Plane()
     : Shape(PRIMITIVE_TYPE::Plane),
       normal({0.f, 0.f, 0.f}) {}
@@ -23,6 +37,12 @@ Box::Box()
     : Shape(PRIMITIVE_TYPE::Box),
       size({0.f, 0.f, 0.f}) {}
 
+Mesh::Mesh()
+    : Shape(PRIMITIVE_TYPE::Mesh) {}
+
+Instance::Instance()
+    : Shape(PRIMITIVE_TYPE::Instance) {}
+
 Light::Light()
     : intensity({0.f, 0.f, 0.f}),
       direction({0.f, 0.f, 0.f}),
@@ -33,6 +53,7 @@ Light::Light()
 Intersection::Intersection()
     : t(0.f),
       normal({0.f, 0.f, 0.f}),
-      inside(false) {}
+      inside(false),
+      shape(nullptr) {}
 
 } // namespace engine
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <optional>
 #include <iostream>
 
@@ -9,10 +10,17 @@
 
 namespace engine {
 
-enum class PRIMITIVE_TYPE { Plane, Ellipsoid, Box };
+enum class PRIMITIVE_TYPE { Plane, Ellipsoid, Box, Mesh, Instance };
 enum class MATERIAL_TYPE { Metallic, Dielectric, Diffuse };
 enum class LIGHT_TYPE { Point, Directed };
 
+// Movement of a shape while the shutter is open: from time 0 to time 1 it translates by `translation` and turns by
+// `rotation` on top of its own rotation.
+struct Motion {
+    glm::vec3 translation{0.f, 0.f, 0.f};
+    glm::quat rotation{1.f, 0.f, 0.f, 0.f};
+};
+
 struct Shape {
     Shape(PRIMITIVE_TYPE type);
 
@@ -23,6 +31,11 @@ struct Shape {
     MATERIAL_TYPE material;
     glm::vec3 emission;
     float ior;
+    std::optional<Motion> motion;
+
+    // Transform at `time` in [0, 1] of the shutter interval.
+    glm::vec3 position_at(float time) const;
+    glm::quat rotation_at(float time) const;
 
     virtual ~Shape() = default;
 };
@@ -45,6 +58,25 @@ struct Box : Shape {
     glm::vec3 size;
 };
 
+struct MeshData;
+
+// Triangle mesh loaded from a file (mesh.hpp); the triangle data is shared by all meshes made from the same file.
+struct Mesh : Shape {
+    Mesh();
+
+    std::shared_ptr<const MeshData> data;
+};
+
+struct ObjectData;
+
+// Placement of a shared group of primitives (instance.hpp). The material of the instance itself is unused: each
+// primitive of the object keeps its own.
+struct Instance : Shape {
+    Instance();
+
+    std::shared_ptr<const ObjectData> object;
+};
+
 struct Light {
     Light();
 
@@ -61,6 +93,8 @@ struct Intersection {
     float t;
     glm::vec3 normal;
     bool inside;
+    // Primitive hit inside an instance, whose material applies; null when the tested primitive itself was hit.
+    Shape* shape;
 };
 
 } // namespace engine
@@ -1,9 +1,13 @@
 #include "ray.hpp"
+#include "glm/common.hpp"
 #include "glm/geometric.hpp"
 #include "primitive.hpp"
 #include "utils.hpp"
 #include "distributions.hpp"
+#include "instance.hpp"
+#include "mesh.hpp"
 
+#include <array>
 #include <cmath>
 #include <limits>
 #include <optional>
@@ -22,6 +26,9 @@ Ray generate_ray(const Scene& scene, std::pair<std::uint32_t, std::uint32_t> pix
     y = -(2.f * y / static_cast<float>(scene.height) - 1) *
         (tanf(scene.camera.camera_fov_x / 2) / (static_cast<float>(scene.width) / scene.height));
     ray.direction = glm::normalize(x * scene.camera.camera_right + y * scene.camera.camera_up + scene.camera.camera_forward);
+    if (scene.motion_blur) {
+        ray.time = rand_uniform01();
+    }
     return ray;
 }
 
@@ -136,9 +143,25 @@ std::optional<Intersection> intersection(Ray& ray, Box* box) {
     return inter;
 }
 
+std::optional<Intersection> intersection(Ray& ray, Mesh* mesh) {
+    auto hit = intersect_mesh(*mesh->data, ray.start, ray.direction);
+    if (!hit.has_value()) {
+        return {};
+    }
+    Intersection inter{};
+    inter.t = hit->t;
+    inter.normal = triangle_normal(*mesh->data, hit->triangle);
+    if (glm::dot(ray.direction, inter.normal) >= 0) {
+        inter.inside = true;
+        inter.normal *= -1;
+    }
+    return inter;
+}
+
 std::optional<Intersection> intersection(Ray ray, Shape* object) {
-    ray.start -= object->position;
-    glm::quat reversed_rotation = glm::inverse(object->rotation);
+    glm::quat rotation = object->rotation_at(ray.time);
+    ray.start -= object->position_at(ray.time);
+    glm::quat reversed_rotation = glm::inverse(rotation);
     ray.start = reversed_rotation * ray.start;
     ray.direction = glm::normalize(reversed_rotation * ray.direction);
 
@@ -153,6 +176,12 @@ std::optional<Intersection> intersection(Ray ray, Shape* object) {
     case PRIMITIVE_TYPE::Box:
         inter = intersection(ray, dynamic_cast<Box*>(object));
         break;
+    case PRIMITIVE_TYPE::Mesh:
+        inter = intersection(ray, dynamic_cast<Mesh*>(object));
+        break;
+    case PRIMITIVE_TYPE::Instance:
+        inter = intersection(ray, dynamic_cast<Instance*>(object));
+        break;
     default:
         throw std::runtime_error("Unknown primitive type");
     }
@@ -160,7 +189,7 @@ std::optional<Intersection> intersection(Ray ray, Shape* object) {
     if (!inter.has_value()) {
         return {};
     }
-    inter->normal = glm::normalize(object->rotation * inter->normal);
+    inter->normal = glm::normalize(rotation * inter->normal);
     return inter;
 }
 
@@ -169,13 +198,14 @@ glm::vec3 calc_diffuse_rawcolor(const Scene& scene, Shape* obj, Ray in_ray, cons
     float eps = 1e-4;
     glm::vec3 inter_point = in_ray.start + in_ray.direction * inter.t;
 
-    auto rnd_dir = scene.distribution->sample(inter_point + eps * inter.normal, inter.normal);
+    auto rnd_dir = scene.distribution->sample(inter_point + eps * inter.normal, inter.normal, in_ray.time);
     if (glm::dot(rnd_dir, inter.normal) < 0) {
         return obj->emission;
     }
-    float pdf = scene.distribution->pdf(inter_point + eps * inter.normal, inter.normal, rnd_dir);
+    float pdf = scene.distribution->pdf(inter_point + eps * inter.normal, inter.normal, rnd_dir, in_ray.time);
 
     Ray out_ray{};
+    out_ray.time = in_ray.time;
     out_ray.direction = glm::normalize(rnd_dir);
     if (glm::dot(out_ray.direction, inter.normal) < 0) {
         out_ray.direction *= -1;
@@ -190,6 +220,7 @@ glm::vec3 calc_metallic_rawcolor(const Scene& scene, Shape* obj, Ray in_ray, con
     float eps = 1e-4;
     glm::vec3 inter_point = in_ray.start + in_ray.direction * inter.t;
     Ray reflected_ray{};
+    reflected_ray.time = in_ray.time;
     reflected_ray.direction = in_ray.direction - 2.f * inter.normal * glm::dot(inter.normal, in_ray.direction);
     reflected_ray.start = inter_point + reflected_ray.direction * eps;
 
@@ -214,6 +245,7 @@ glm::vec3 calc_dielectric_rawcolor(const Scene& scene, Shape* obj, Ray in_ray, c
     float coin_toss = rand_uniform01();
     if (std::abs(sin_theta2) > 1 || coin_toss < reflection_coef) {
         Ray reflected_ray{};
+        reflected_ray.time = in_ray.time;
         reflected_ray.direction = in_ray.direction - 2.f * inter.normal * glm::dot(inter.normal, in_ray.direction);
         reflected_ray.start = inter_point + reflected_ray.direction * eps;
         glm::vec3 reflected_color = raytrace(reflected_ray, scene, ray_depth + 1).second;
@@ -226,6 +258,7 @@ glm::vec3 calc_dielectric_rawcolor(const Scene& scene, Shape* obj, Ray in_ray, c
 
     float cos_theta2 = sqrt(1 - sin_theta2 * sin_theta2);
     Ray refracted_ray{};
+    refracted_ray.time = in_ray.time;
     refracted_ray.direction = (air_ior / obj_ior) * in_ray.direction + (air_ior / obj_ior * cos_theta1 - cos_theta2) * inter.normal;
     refracted_ray.start = inter_point + refracted_ray.direction * eps;
     glm::vec3 refracted_color = raytrace(refracted_ray, scene, ray_depth + 1).second;
@@ -250,29 +283,121 @@ glm::vec3 calc_color(const Scene& scene, Shape* obj, Ray ray, const Intersection
     return glm::vec3{};
 }
 
+bool intersect_aabb(const Ray& ray, const glm::vec3& inv_direction, const Aabb& bounds, float t_max) {
+    glm::vec3 t_1 = (bounds.min - ray.start) * inv_direction;
+    glm::vec3 t_2 = (bounds.max - ray.start) * inv_direction;
+    glm::vec3 t_near = glm::min(t_1, t_2);
+    glm::vec3 t_far = glm::max(t_1, t_2);
+    float t_enter = std::max(std::max(t_near.x, t_near.y), std::max(t_near.z, 0.f));
+    float t_exit = std::min(std::min(t_far.x, t_far.y), std::min(t_far.z, t_max));
+    return t_enter <= t_exit;
+}
+
+namespace {
+
+void test_primitive(Ray& ray, Shape* primitive, std::uint32_t index, std::optional<Hit>& closest) {
+    auto inter = intersection(ray, primitive);
+    if (inter.has_value() && (!closest.has_value() || closest->inter.t > inter->t)) {
+        closest = Hit{inter->shape != nullptr ? inter->shape : primitive, index, inter.value()};
+    }
+}
+
+void traverse(Ray& ray, const Bvh& bvh, const std::vector<Shape*>& primitives, std::optional<Hit>& closest) {
+    if (bvh.nodes.empty()) {
+        return;
+    }
+    const glm::vec3 inv_direction = 1.f / ray.direction;
+    std::array<std::uint32_t, Bvh::max_depth + 1> stack;
+    std::size_t stack_size = 0;
+    stack[stack_size++] = 0;
+    while (stack_size > 0) {
+        std::uint32_t node_index = stack[--stack_size];
+        const BvhNode& node = bvh.nodes[node_index];
+        float t_max = closest.has_value() ? closest->inter.t : std::numeric_limits<float>::infinity();
+        if (!intersect_aabb(ray, inv_direction, node.bounds, t_max)) {
+            continue;
+        }
+        if (node.count > 0) {
+            for (std::uint32_t i = 0; i < node.count; ++i) {
+                std::uint32_t index = bvh.indices[node.offset + i];
+                test_primitive(ray, primitives[index], index, closest);
+            }
+        }
+        else {
+            stack[stack_size++] = node.offset;
+            stack[stack_size++] = node_index + 1;
+        }
+    }
+}
+
+} // namespace
+
+std::optional<Intersection> intersection(Ray& ray, Instance* instance) {
+    std::optional<Hit> closest{std::nullopt};
+    traverse(ray, instance->object->bvh, instance->object->primitives, closest);
+    if (!closest.has_value()) {
+        return {};
+    }
+    Intersection inter = closest->inter;
+    inter.shape = closest->primitive;
+    return inter;
+}
+
+std::optional<Hit> closest_intersection(Ray& ray, const Scene& scene) {
+    std::optional<Hit> closest{std::nullopt};
+    for (std::uint32_t index : scene.bvh.unbounded) {
+        test_primitive(ray, scene.primitives[index], index, closest);
+    }
+    if (!scene.flat.empty()) {
+        // Few primitives: test them 8 at a time and intersect only the nearest of each block in full.
+        for (const PrimitiveBlock& block : scene.flat.blocks) {
+            auto [t, index] = FlatPrimitives::nearest(block, ray.start, ray.direction);
+            if (index != FlatPrimitives::no_hit && (!closest.has_value() || closest->inter.t > t)) {
+                test_primitive(ray, scene.primitives[index], index, closest);
+            }
+        }
+        return closest;
+    }
+    traverse(ray, scene.bvh, scene.primitives, closest);
+    return closest;
+}
+
+static thread_local std::uint64_t rays_counter = 0;
+
+std::uint64_t traced_rays() {
+    return rays_counter;
+}
+
+void count_traced_rays(std::uint64_t count) {
+    rays_counter += count;
+}
+
+static thread_local Bounce* bounce_record = nullptr;
+
+void record_bounce(Bounce* bounce) {
+    bounce_record = bounce;
+}
+
 std::pair<std::optional<float>, glm::vec3> raytrace(Ray& ray, const Scene& scene, std::uint32_t ray_depth) {
     glm::vec3 color = scene.bg_color;
     std::optional<float> inter_t{std::nullopt};
-    std::optional<Intersection> closest_inter{std::nullopt};
-    Shape* closest_primitive = nullptr;
 
     if (ray_depth == scene.ray_depth) {
         return {inter_t, color};
     }
+    ++rays_counter;
 
-    for (auto primitive : scene.primitives) {
-        auto cur_inter = intersection(ray, primitive);
-        if (!cur_inter.has_value()) {
-            continue;
-        }
-        if (!inter_t.has_value() || inter_t.value() > cur_inter->t) {
-            inter_t = cur_inter->t;
-            closest_inter = cur_inter;
-            closest_primitive = primitive;
-        }
+    auto hit = closest_intersection(ray, scene);
+    Bounce* bounce = ray_depth == 1 ? bounce_record : nullptr;
+    if (bounce != nullptr) {
+        bounce->emission = hit.has_value() ? hit->primitive->emission : scene.bg_color;
+    }
+    if (hit.has_value()) {
+        inter_t = hit->inter.t;
+        color = calc_color(scene, hit->primitive, ray, hit->inter, ray_depth);
     }
-    if (closest_inter.has_value()) {
-        color = calc_color(scene, closest_primitive, ray, closest_inter.value(), ray_depth);
+    if (bounce != nullptr) {
+        bounce->radiance = color;
     }
     return {inter_t, color};
 }
@@ -16,19 +16,48 @@ using Color = std::array<std::uint8_t, 3>;
 struct Ray {
     Ray()
         : start({0.f, 0.f, 0.f}),
-          direction({0.f, 0.f, 0.f}) {}
+          direction({0.f, 0.f, 0.f}),
+          time(0.f) {}
 
     glm::vec3 start;
     glm::vec3 direction;
+    // Moment in the shutter interval the ray travels at, [0, 1). Moving primitives are intersected at that moment.
+    float time;
+};
+
+struct Hit {
+    // The primitive that was hit: inside an instance, the object's primitive rather than the instance.
+    Shape* primitive;
+    // Scene primitive the hit belongs to.
+    std::uint32_t index;
+    Intersection inter;
 };
 
 Ray generate_ray(const Scene& scene, std::pair<std::uint32_t, std::uint32_t> pixel_coord);
 std::optional<Intersection> intersection(Ray& ray, Plane* plane);
 std::optional<Intersection> intersection(Ray& ray, Ellipsoid* sphere);
 std::optional<Intersection> intersection(Ray& ray, Box* box);
+std::optional<Intersection> intersection(Ray& ray, Mesh* mesh);
+// Closest primitive of the object, with the ray already in instance space; Intersection::shape tells which.
+std::optional<Intersection> intersection(Ray& ray, Instance* instance);
 std::optional<Intersection> intersection(Ray ray, Shape* object);
+bool intersect_aabb(const Ray& ray, const glm::vec3& inv_direction, const Aabb& bounds, float t_max);
+std::optional<Hit> closest_intersection(Ray& ray, const Scene& scene);
 std::pair<std::optional<float>, glm::vec3> raytrace(Ray& ray, const Scene& scene, std::uint32_t ray_depth);
 
+// Number of rays traced against the scene by the calling thread.
+std::uint64_t traced_rays();
+void count_traced_rays(std::uint64_t count);
+
+// What the first bounce of a camera path found: the emission at its hit (the background on a miss) and all the
+// radiance it brought back. The direct and indirect AOVs split a pixel with it.
+struct Bounce {
+    glm::vec3 emission;
+    glm::vec3 radiance;
+};
+// While set, every ray traced at depth 1 by the calling thread writes its result to `bounce`; nullptr stops.
+void record_bounce(Bounce* bounce);
+
 glm::vec3 calc_color(const Scene& scene, Shape* obj, Ray ray, const Intersection& inter, std::uint32_t ray_depth);
 glm::vec3 calc_diffuse_rawcolor(const Scene& scene, Shape* obj, Ray ray, const Intersection& inter, std::uint32_t ray_depth);
 glm::vec3 calc_metallic_rawcolor(const Scene& scene, Shape* obj, Ray ray, const Intersection& inter, std::uint32_t ray_depth);
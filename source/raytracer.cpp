@@ -0,0 +1,159 @@
+#include "raytracer.hpp"
+#include "io.hpp"
+#include "kernels.hpp"
+#include "numa.hpp"
+#include "trace.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <sstream>
+#include <thread>
+
+namespace engine {
+
+Scene load_scene(const std::string& path, LIGHT_SAMPLING light_sampling, const std::string& bvh_cache) {
+    return io::load_scene(path, light_sampling, bvh_cache);
+}
+
+void prepare_scene(Scene& scene) {
+    scene.init_light_distrs();
+    scene.init_bvh();
+}
+
+Renderer::Renderer(std::size_t threads, bool pin_threads)
+    : workers(std::make_unique<ThreadPool>(threads, pin_threads)) {}
+
+std::size_t Renderer::threads() const {
+    return workers->size();
+}
+
+ThreadPool& Renderer::pool() {
+    return *workers;
+}
+
+void Renderer::render(const Scene& scene, const RenderOptions& options, float* radiance) {
+    static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "Radiance buffer must alias packed RGB floats");
+    RenderOptions pooled = options;
+    pooled.multithread = false;
+    pooled.pool = workers.get();
+    if (&scene == replicated) {
+        pooled.replicas = &replica_views;
+    }
+    engine::render(scene, pooled, reinterpret_cast<glm::vec3*>(radiance));
+}
+
+void Renderer::render(const Scene& scene, const RenderOptions& options, std::uint8_t* rgb) {
+    // Left uninitialized so every page is first touched, and placed, by the worker that renders into it.
+    const std::size_t pixels = resolve_region(scene, options).size();
+    std::unique_ptr<glm::vec3[]> hdr = std::make_unique_for_overwrite<glm::vec3[]>(pixels);
+    render(scene, options, &hdr[0].x);
+    trace::Span span("post_process");
+    kernels().tone_map(&hdr[0].x, pixels, rgb);
+}
+
+void Renderer::replicate(const Scene& scene) {
+    trace::Span span("replicate");
+    replicated = nullptr;
+    replicas.clear();
+    replica_views.clear();
+    const std::vector<std::vector<int>>& nodes = numa::topology().nodes;
+    if (nodes.size() < 2) {
+        return;
+    }
+    std::ostringstream out;
+    io::write_binary_scene(out, scene);
+    const std::string bytes = out.str();
+    replicas.resize(nodes.size());
+    for (std::size_t node = 0; node < nodes.size(); ++node) {
+        std::exception_ptr error;
+        std::thread([&] {
+            try {
+                numa::pin_thread(nodes[node]);
+                std::istringstream in(bytes);
+                replicas[node] = std::make_unique<Scene>(io::parse_scene(in, scene.light_sampling));
+            }
+            catch (...) {
+                error = std::current_exception();
+            }
+        }).join();
+        if (error) {
+            replicas.clear();
+            replica_views.clear();
+            std::rethrow_exception(error);
+        }
+        replica_views.push_back(replicas[node].get());
+    }
+    replicated = &scene;
+}
+
+Session::Session(Renderer& renderer, Scene scene)
+    : renderer(renderer),
+      resident(std::move(scene)),
+      sum(static_cast<std::size_t>(resident.width) * resident.height, glm::vec3{0.f, 0.f, 0.f}),
+      pass(sum.size()),
+      samples(0),
+      passes(0) {}
+
+const Scene& Session::scene() const {
+    return resident;
+}
+
+const Camera& Session::camera() const {
+    return resident.camera;
+}
+
+void Session::set_camera(const Camera& camera) {
+    resident.camera = camera;
+    std::fill(sum.begin(), sum.end(), glm::vec3{0.f, 0.f, 0.f});
+    samples = 0;
+    passes = 0;
+}
+
+std::uint32_t Session::refine(const RenderOptions& options) {
+    if (converged()) {
+        return samples;
+    }
+    RenderOptions pass_options = options;
+    pass_options.region = Region{};
+    pass_options.samples = std::min(std::max(1u, samples), std::max(resident.samples, 1u) - samples);
+    pass_options.cost_map = nullptr;
+    if (options.seed.has_value()) {
+        pass_options.seed = mix_seed(options.seed.value(), passes);
+    }
+    renderer.render(resident, pass_options, &pass.data()->x);
+
+    const float weight = static_cast<float>(pass_options.samples);
+    for (std::size_t i = 0; i < sum.size(); ++i) {
+        sum[i] += weight * pass[i];
+    }
+    samples += pass_options.samples;
+    ++passes;
+    return samples;
+}
+
+std::uint32_t Session::accumulated_samples() const {
+    return samples;
+}
+
+bool Session::converged() const {
+    return samples >= std::max(resident.samples, 1u);
+}
+
+void Session::radiance(float* out) const {
+    const float scale = samples > 0 ? 1.f / static_cast<float>(samples) : 0.f;
+    for (std::size_t i = 0; i < sum.size(); ++i) {
+        glm::vec3 mean = scale * sum[i];
+        out[i * 3] = mean.r;
+        out[i * 3 + 1] = mean.g;
+        out[i * 3 + 2] = mean.b;
+    }
+}
+
+void Session::image(std::uint8_t* rgb) const {
+    HdrImage mean(sum.size());
+    radiance(&mean.data()->x);
+    kernels().tone_map(&mean.data()->x, mean.size(), rgb);
+}
+
+} // namespace engine
@@ -0,0 +1,95 @@
+#pragma once
+
+// Embeddable interface of the renderer, built as the `raytracer` library. The `engine` executable is a client of it.
+
+#include "image.hpp"
+#include "scene.hpp"
+#include "thread_pool.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace engine {
+
+// Bumped whenever a declaration in this header changes incompatibly.
+constexpr int raytracer_api_version = 1;
+
+// Parses a scene file and prepares it for rendering. With a `bvh_cache` directory the BVH is reused from there when
+// the primitives have not changed since it was written.
+Scene load_scene(const std::string& path,
+                 LIGHT_SAMPLING light_sampling = LIGHT_SAMPLING::Tree,
+                 const std::string& bvh_cache = "");
+
+// Finishes a scene built in code: after filling in camera, settings and primitives (allocated with new, the scene
+// takes ownership), call this once before rendering. Builds the light distributions and the BVH.
+void prepare_scene(Scene& scene);
+
+class Renderer {
+public:
+    // 0 starts one worker thread per hardware thread. With `pin_threads` the workers are pinned to CPUs spread evenly
+    // over the NUMA nodes.
+    explicit Renderer(std::size_t threads = 0, bool pin_threads = false);
+
+    std::size_t threads() const;
+    // Worker pool shared by all renders of this renderer.
+    ThreadPool& pool();
+
+    // Renders options.region (the whole image if empty) into the caller's buffer, row by row over the region:
+    // 3 floats of linear radiance per pixel. options.pool and options.multithread are ignored, the renderer's pool
+    // is used. Safe to call from several threads; concurrent renders take turns on the pool.
+    void render(const Scene& scene, const RenderOptions& options, float* radiance);
+    // Same, tone mapped and gamma corrected to 3 bytes per pixel.
+    void render(const Scene& scene, const RenderOptions& options, std::uint8_t* rgb);
+
+    // On machines with several NUMA nodes, makes a copy of the scene per node, each built by a thread running on it so
+    // primitives, BVH and light distributions sit in the node's memory. Later renders of this scene object read the
+    // copy of the node their thread runs on. The copies go through the binary scene format, so animation is reset to
+    // time 0 and later changes to the scene are not seen: replicate again after changing it. Not to be called while
+    // rendering.
+    void replicate(const Scene& scene);
+
+private:
+    std::unique_ptr<ThreadPool> workers;
+    const Scene* replicated = nullptr;
+    std::vector<std::unique_ptr<Scene>> replicas;
+    std::vector<const Scene*> replica_views;
+};
+
+// A prepared scene kept resident for interactive use: primitives, light distributions and the BVH stay as they are
+// and only the camera changes. Every camera change restarts a progressive render that accumulates passes of 1, 1, 2,
+// 4, ... samples per pixel, so the first, noisy frame is a single sample per pixel. Not thread-safe: drive a session
+// from one thread.
+class Session {
+public:
+    Session(Renderer& renderer, Scene scene);
+
+    const Scene& scene() const;
+    const Camera& camera() const;
+    // Replaces the camera and drops the accumulated samples.
+    void set_camera(const Camera& camera);
+
+    // Renders the next pass over the whole image (options.region and options.samples are ignored; with a seed, every
+    // pass uses its own stream) and returns the samples per pixel accumulated so far. The last pass is cut short at the
+    // scene's SAMPLES; once converged, nothing is rendered.
+    std::uint32_t refine(const RenderOptions& options = {});
+    std::uint32_t accumulated_samples() const;
+    // True once the scene's SAMPLES (at least one) are reached.
+    bool converged() const;
+
+    // Current estimate: mean radiance per pixel, 3 floats each, or tone mapped to 3 bytes each.
+    void radiance(float* out) const;
+    void image(std::uint8_t* rgb) const;
+
+private:
+    Renderer& renderer;
+    Scene resident;
+    HdrImage sum;
+    HdrImage pass;
+    std::uint32_t samples;
+    std::uint32_t passes;
+};
+
+} // namespace engine
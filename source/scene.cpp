@@ -1,33 +1,95 @@
 #include "scene.hpp"
+#include "alias.hpp"
+#include "bvh_cache.hpp"
 #include "distributions.hpp"
+#include "instance.hpp"
+#include "light_tree.hpp"
+#include "mesh.hpp"
 #include "primitive.hpp"
+#include "trace.hpp"
 
+#include <algorithm>
 #include <memory>
 #include <stdexcept>
 
 namespace engine {
 
+namespace {
+
+// Whether any of the primitives, or of the primitives of the objects they instance, moves.
+bool has_motion(const std::vector<Shape*>& primitives) {
+    return std::any_of(primitives.begin(), primitives.end(), [](const Shape* primitive) {
+        return primitive->motion.has_value() ||
+               (primitive->type == PRIMITIVE_TYPE::Instance &&
+                has_motion(dynamic_cast<const Instance*>(primitive)->object->primitives));
+    });
+}
+
+} // namespace
+
 void Scene::init_light_distrs() {
-    std::vector<std::unique_ptr<rand::IDistribution>> distrs;
+    trace::Span span("init_light_distrs");
+
+    std::vector<Shape*> emitters;
     for (auto& primitive : primitives) {
-        if (primitive->emission != glm::vec3{0.f, 0.f, 0.f}) {
-            distrs.emplace_back(std::make_unique<rand::Light>(primitive));
+        // Emitters inside instances are only found by the cosine lobe.
+        if (primitive->emission != glm::vec3{0.f, 0.f, 0.f} && primitive->type != PRIMITIVE_TYPE::Plane &&
+            primitive->type != PRIMITIVE_TYPE::Instance) {
+            emitters.push_back(primitive);
         }
     }
     std::vector<std::unique_ptr<rand::IDistribution>> mix_distrs;
     mix_distrs.emplace_back(std::make_unique<rand::Cosine>());
 
-    if (!distrs.empty()) {
+    if (!emitters.empty() && light_sampling == LIGHT_SAMPLING::Tree) {
+        mix_distrs.emplace_back(std::make_unique<rand::LightTree>(emitters));
+    }
+    else if (!emitters.empty() && light_sampling == LIGHT_SAMPLING::Power) {
+        mix_distrs.emplace_back(std::make_unique<rand::PowerLights>(emitters));
+    }
+    else if (!emitters.empty()) {
+        std::vector<std::unique_ptr<rand::IDistribution>> distrs;
+        for (Shape* emitter : emitters) {
+            distrs.emplace_back(std::make_unique<rand::Light>(emitter));
+        }
         mix_distrs.emplace_back(std::make_unique<rand::Mix>(std::move(distrs)));
     }
-    distribution = new rand::Mix(std::move(mix_distrs));
+    distribution = std::make_unique<rand::Mix>(std::move(mix_distrs));
+}
+
+void Scene::init_bvh(const std::string& cache_directory) {
+    trace::Span span("build_bvh");
+
+    if (cache_directory.empty()) {
+        bvh.build(primitives);
+    }
+    else {
+        std::uint64_t key = bvh_cache::key(primitives);
+        std::string path = bvh_cache::path(cache_directory, key);
+        if (!bvh_cache::load(path, key, primitives.size(), bvh)) {
+            bvh.build(primitives);
+            bvh_cache::store(path, key, primitives.size(), bvh);
+        }
+    }
+    flat.build(primitives);
+    motion_blur = has_motion(primitives);
+}
+
+void Scene::update_transforms(ThreadPool* pool, bool lights) {
+    trace::Span span("refit_bvh");
+
+    bvh.update(primitives, pool);
+    flat.build(primitives);
+    motion_blur = has_motion(primitives);
+    if (lights) {
+        init_light_distrs();
+    }
 }
 
 Scene::~Scene() {
     for (Shape* primitive : primitives) {
         delete primitive;
     }
-    delete distribution;
 }
 
 std::ostream& operator<<(std::ostream& out, const Scene& scene) {
@@ -59,6 +121,12 @@ std::ostream& operator<<(std::ostream& out, const Scene& scene) {
             Box* plane = dynamic_cast<Box*>(primitive);
             out << plane->size.x << ' ' << plane->size.y << ' ' << plane->size.z << '\n';
         }
+        else if (primitive->type == PRIMITIVE_TYPE::Mesh) {
+            out << "Mesh " << dynamic_cast<Mesh*>(primitive)->data->triangle_count() << " triangles\n";
+        }
+        else if (primitive->type == PRIMITIVE_TYPE::Instance) {
+            out << "Instance of " << dynamic_cast<Instance*>(primitive)->object->primitives.size() << " primitives\n";
+        }
         out << "Position: " << primitive->position.x << ' ' << primitive->position.y << ' ' << primitive->position.z << '\n'
             << "Color: " << primitive->color.x << ' ' << primitive->color.y << ' ' << primitive->color.z << '\n'
             << "Material: ";
@@ -1,6 +1,9 @@
 #pragma once
 
+#include "animation.hpp"
+#include "bvh.hpp"
 #include "distributions.hpp"
+#include "flat.hpp"
 #include "glm/vec3.hpp"
 
 #include "primitive.hpp"
@@ -9,6 +12,7 @@
 #include <iostream>
 #include <vector>
 #include <memory>
+#include <string>
 
 namespace engine {
 
@@ -20,18 +24,38 @@ struct Camera {
     glm::vec3 camera_forward;
 };
 
+// How diffuse bounces pick the emitter to sample: uniformly, through a light tree weighted by power and distance, or
+// from an alias table weighted by power alone.
+enum class LIGHT_SAMPLING { Uniform, Tree, Power };
+
 struct Scene {
-    std::uint32_t height;
-    std::uint32_t width;
+    std::uint32_t height = 0;
+    std::uint32_t width = 0;
     glm::vec3 bg_color;
     Camera camera;
-    std::uint32_t ray_depth;
-    std::uint32_t samples;
+    std::uint32_t ray_depth = 0;
+    std::uint32_t samples = 0;
     std::vector<Shape*> primitives;
-    rand::Mix* distribution;
+    std::unique_ptr<rand::Mix> distribution;
+    LIGHT_SAMPLING light_sampling = LIGHT_SAMPLING::Tree;
+    Bvh bvh;
+    FlatPrimitives flat;
+    Animation animation;
+    // Some primitive moves while the shutter is open, objects included: camera rays get a random time. Set by init_bvh.
+    bool motion_blur = false;
 
     void init_light_distrs();
+    // With a cache directory the tree is mapped from the file keyed by the primitive bounds when there is a valid
+    // one, and built and written there otherwise (bvh_cache.hpp).
+    void init_bvh(const std::string& cache_directory = "");
+    // Brings the acceleration structures and light distributions up to date after primitive transforms changed.
+    // The BVH is refit rather than rebuilt unless its quality has degraded too far; light distributions are only
+    // rebuilt when `lights` is set, i.e. when an emitter moved.
+    void update_transforms(ThreadPool* pool = nullptr, bool lights = true);
 
+    Scene() = default;
+    // Scenes own their primitives, so they can be moved but not copied.
+    Scene(Scene&& other) = default;
     ~Scene();
 };
 
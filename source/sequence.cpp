@@ -0,0 +1,75 @@
+#include "sequence.hpp"
+#include "io.hpp"
+#include "trace.hpp"
+
+#include <future>
+#include <stdexcept>
+
+namespace engine::sequence {
+
+std::string frame_path(const std::string& pattern, std::uint32_t frame) {
+    std::size_t slash = pattern.find_last_of('/');
+    std::size_t begin = pattern.find('#', slash == std::string::npos ? 0 : slash);
+    std::string path = pattern;
+    std::size_t width = 4;
+    if (begin == std::string::npos) {
+        std::size_t dot = pattern.find_last_of('.');
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+            dot = pattern.size();
+        }
+        path = pattern.substr(0, dot) + "_" + pattern.substr(dot);
+        begin = dot + 1;
+    }
+    else {
+        std::size_t end = pattern.find_first_not_of('#', begin);
+        width = (end == std::string::npos ? pattern.size() : end) - begin;
+        path.erase(begin, width);
+    }
+    std::string number = std::to_string(frame);
+    if (number.size() < width) {
+        number.insert(0, width - number.size(), '0');
+    }
+    path.insert(begin, number);
+    return path;
+}
+
+void render(Scene& scene,
+            const std::string& pattern,
+            const RenderOptions& options,
+            std::uint32_t first,
+            std::uint32_t count,
+            const std::function<void(std::uint32_t)>& frame_done) {
+    const std::uint32_t frames = scene.animation.frame_count();
+    if (first >= frames) {
+        throw std::runtime_error("First frame is past the end of the animation.");
+    }
+    const std::uint32_t last = count == 0 ? frames : std::min(frames, first + count);
+
+    std::future<void> writing;
+    for (std::uint32_t frame = first; frame < last; ++frame) {
+        trace::Span span("frame " + std::to_string(frame));
+        Animation::Changes changes = scene.animation.apply(scene, static_cast<float>(frame));
+        if (changes.primitives) {
+            scene.update_transforms(options.pool, changes.emitters);
+        }
+        Image image = generate_image(scene, options);
+        if (frame_done) {
+            frame_done(frame);
+        }
+
+        if (writing.valid()) {
+            writing.get();
+        }
+        writing = std::async(std::launch::async,
+                             [path = frame_path(pattern, frame), width = scene.width, height = scene.height,
+                              image = std::move(image)] {
+                                 trace::Span span("write_image " + path);
+                                 io::write_image(path, width, height, image);
+                             });
+    }
+    if (writing.valid()) {
+        writing.get();
+    }
+}
+
+} // namespace engine::sequence
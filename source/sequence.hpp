@@ -0,0 +1,27 @@
+#pragma once
+
+#include "image.hpp"
+#include "scene.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace engine::sequence {
+
+// "out/frame_####.ppm" -> "out/frame_0007.ppm", the run of '#' giving the minimum width. Without '#' the frame
+// number is added before the extension: "out/frame.ppm" -> "out/frame_0007.ppm".
+std::string frame_path(const std::string& pattern, std::uint32_t frame);
+
+// Renders `count` frames of the scene's animation starting at `first` (0 renders up to the last frame) and writes
+// them to frame_path(pattern, frame). The scene is parsed and prepared once: between frames only the camera moves,
+// the BVH of moved primitives is refit and light distributions are rebuilt only when an emitter moved. Each image
+// is written while the next frame renders. frame_done is called after each frame is rendered.
+void render(Scene& scene,
+            const std::string& pattern,
+            const RenderOptions& options,
+            std::uint32_t first = 0,
+            std::uint32_t count = 0,
+            const std::function<void(std::uint32_t)>& frame_done = {});
+
+} // namespace engine::sequence
@@ -0,0 +1,275 @@
+#include "server.hpp"
+#include "io.hpp"
+#include "kernels.hpp"
+#include "net.hpp"
+#include "trace.hpp"
+
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace engine::server {
+
+namespace {
+
+using net::read_all;
+using net::Socket;
+using net::write_all;
+
+sockaddr_un socket_address(const std::string& path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Socket path is too long: " + path);
+    }
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    return address;
+}
+
+std::uint64_t content_hash(const std::string& bytes, LIGHT_SAMPLING light_sampling) {
+    // FNV-1a.
+    std::uint64_t hash = 0xCBF29CE484222325ull;
+    for (unsigned char byte : bytes) {
+        hash = (hash ^ byte) * 0x100000001B3ull;
+    }
+    return (hash ^ static_cast<std::uint64_t>(light_sampling)) * 0x100000001B3ull;
+}
+
+// Least recently used scenes are dropped first. Scenes are shared, so one evicted while a request still renders it
+// lives until that request is done.
+class SceneCache {
+public:
+    explicit SceneCache(std::size_t capacity) : capacity(capacity) {}
+
+    std::shared_ptr<const Scene> get(const std::string& bytes, LIGHT_SAMPLING light_sampling, bool& cached) {
+        std::uint64_t key = content_hash(bytes, light_sampling);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = entries.find(key);
+            // The hash only picks the entry; a collision must not hand out another client's scene.
+            if (it != entries.end() && it->second.light_sampling == light_sampling && it->second.bytes == bytes) {
+                order.splice(order.begin(), order, it->second.position);
+                cached = true;
+                return it->second.scene;
+            }
+        }
+
+        cached = false;
+        std::istringstream in(bytes);
+        auto scene = std::make_shared<const Scene>(io::parse_scene(in, light_sampling));
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            // Same hash, other scene: the newer one takes the slot.
+            it->second = Entry{scene, bytes, light_sampling, it->second.position};
+            order.splice(order.begin(), order, it->second.position);
+        }
+        else {
+            order.push_front(key);
+            entries.emplace(key, Entry{scene, bytes, light_sampling, order.begin()});
+            if (entries.size() > capacity) {
+                entries.erase(order.back());
+                order.pop_back();
+            }
+        }
+        return scene;
+    }
+
+private:
+    struct Entry {
+        std::shared_ptr<const Scene> scene;
+        std::string bytes;
+        LIGHT_SAMPLING light_sampling;
+        std::list<std::uint64_t>::iterator position;
+    };
+
+    std::size_t capacity;
+    std::mutex mutex;
+    std::list<std::uint64_t> order;
+    std::unordered_map<std::uint64_t, Entry> entries;
+};
+
+void send_error(int fd, const std::string& message) {
+    ResponseHeader header{1, 0, 0, 0, message.size()};
+    write_all(fd, &header, sizeof(header));
+    write_all(fd, message.data(), message.size());
+}
+
+// streaming is set once the response header went out; an error after that cannot be reported in band.
+void handle_request(int fd,
+                    const RequestHeader& request,
+                    const std::string& bytes,
+                    Renderer& renderer,
+                    SceneCache& cache,
+                    bool verbose,
+                    bool& streaming) {
+    trace::Span span("request");
+    if (request.light_sampling > static_cast<std::uint32_t>(LIGHT_SAMPLING::Power) || request.integrator > 1) {
+        throw std::runtime_error("Bad render options.");
+    }
+    bool cached = false;
+    std::shared_ptr<const Scene> scene = cache.get(bytes, static_cast<LIGHT_SAMPLING>(request.light_sampling), cached);
+
+    RenderOptions options;
+    options.samples = request.samples;
+    if (request.has_seed != 0) {
+        options.seed = request.seed;
+    }
+    options.region = Region{request.region[0], request.region[1], request.region[2], request.region[3]};
+    options.integrator = static_cast<INTEGRATOR>(request.integrator);
+    options.packet_width = request.packet_width;
+    Region region = resolve_region(*scene, options);
+
+    HdrImage hdr(region.size());
+    std::vector<std::uint8_t> rgb;
+    auto send_header = [&] {
+        ResponseHeader header{0, region.width(), region.height(), cached ? 1u : 0u, 0};
+        streaming = true;
+        write_all(fd, &header, sizeof(header));
+    };
+    options.tile_done = [&](std::size_t begin, std::size_t end) {
+        if (!streaming) {
+            send_header();
+        }
+        rgb.resize((end - begin) * 3);
+        kernels().tone_map(&hdr[begin].x, end - begin, rgb.data());
+        TileHeader tile{static_cast<std::uint32_t>(begin), static_cast<std::uint32_t>(end - begin)};
+        write_all(fd, &tile, sizeof(tile));
+        write_all(fd, rgb.data(), rgb.size());
+    };
+    renderer.render(*scene, options, &hdr.data()->x);
+    if (!streaming) {
+        send_header();
+    }
+    TileHeader last{0, 0};
+    write_all(fd, &last, sizeof(last));
+    if (verbose) {
+        std::cout << "rendered " << region.width() << 'x' << region.height() << (cached ? " (cached scene)" : "")
+                  << std::endl;
+    }
+}
+
+void handle_connection(int fd, Renderer& renderer, SceneCache& cache, bool verbose) {
+    Socket connection(fd);
+    try {
+        RequestHeader request;
+        while (read_all(fd, &request, sizeof(request))) {
+            if (request.magic != request_magic || request.version != protocol_version) {
+                send_error(fd, "Unknown protocol.");
+                return;
+            }
+            if (request.scene_size > max_scene_size) {
+                send_error(fd, "Scene is too large.");
+                return;
+            }
+            std::string bytes(request.scene_size, '\0');
+            read_all(fd, bytes.data(), bytes.size());
+            bool streaming = false;
+            try {
+                handle_request(fd, request, bytes, renderer, cache, verbose, streaming);
+            }
+            catch (const std::exception& e) {
+                if (streaming) {
+                    throw;
+                }
+                send_error(fd, e.what());
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        if (verbose) {
+            std::cerr << e.what() << std::endl;
+        }
+    }
+}
+
+} // namespace
+
+void serve(const std::string& socket_path, Renderer& renderer, std::size_t cache_capacity, bool verbose) {
+    sockaddr_un address = socket_address(socket_path);
+    Socket listener(socket(AF_UNIX, SOCK_STREAM, 0));
+    if (listener.get() < 0) {
+        throw std::runtime_error("Failed to create socket.");
+    }
+    unlink(socket_path.c_str());
+    if (bind(listener.get(), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listener.get(), 64) != 0) {
+        throw std::runtime_error("Failed to listen on " + socket_path);
+    }
+    if (verbose) {
+        std::cout << "listening on " << socket_path << " with " << renderer.threads() << " threads" << std::endl;
+    }
+
+    SceneCache cache(cache_capacity);
+    while (true) {
+        int fd = accept(listener.get(), nullptr, nullptr);
+        if (fd < 0) {
+            continue;
+        }
+        std::thread(handle_connection, fd, std::ref(renderer), std::ref(cache), verbose).detach();
+    }
+}
+
+ClientResult request(const std::string& socket_path,
+                     const std::string& scene,
+                     const RenderOptions& options,
+                     LIGHT_SAMPLING light_sampling) {
+    sockaddr_un address = socket_address(socket_path);
+    Socket connection(socket(AF_UNIX, SOCK_STREAM, 0));
+    if (connection.get() < 0 ||
+        connect(connection.get(), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        throw std::runtime_error("Failed to connect to " + socket_path);
+    }
+
+    RequestHeader header{};
+    header.magic = request_magic;
+    header.version = protocol_version;
+    header.scene_size = scene.size();
+    header.samples = options.samples;
+    header.has_seed = options.seed.has_value() ? 1 : 0;
+    header.seed = options.seed.value_or(0);
+    header.region[0] = options.region.x0;
+    header.region[1] = options.region.y0;
+    header.region[2] = options.region.x1;
+    header.region[3] = options.region.y1;
+    header.integrator = static_cast<std::uint32_t>(options.integrator);
+    header.packet_width = static_cast<std::uint32_t>(options.packet_width);
+    header.light_sampling = static_cast<std::uint32_t>(light_sampling);
+    write_all(connection.get(), &header, sizeof(header));
+    write_all(connection.get(), scene.data(), scene.size());
+
+    ResponseHeader response;
+    if (!read_all(connection.get(), &response, sizeof(response))) {
+        throw std::runtime_error("Server closed the connection.");
+    }
+    if (response.status != 0) {
+        std::string message(response.message_size, '\0');
+        read_all(connection.get(), message.data(), message.size());
+        throw std::runtime_error("Server error: " + message);
+    }
+
+    ClientResult result{response.width, response.height, response.cached != 0, {}};
+    result.image.resize(static_cast<std::size_t>(response.width) * response.height * 3);
+    TileHeader tile;
+    while (read_all(connection.get(), &tile, sizeof(tile)) && tile.count > 0) {
+        if (static_cast<std::size_t>(tile.begin + tile.count) * 3 > result.image.size()) {
+            throw std::runtime_error("Server sent a tile outside the image.");
+        }
+        read_all(connection.get(), result.image.data() + static_cast<std::size_t>(tile.begin) * 3,
+                 static_cast<std::size_t>(tile.count) * 3);
+    }
+    return result;
+}
+
+} // namespace engine::server
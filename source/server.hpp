@@ -0,0 +1,72 @@
+#pragma once
+
+#include "image.hpp"
+#include "raytracer.hpp"
+#include "scene.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace engine::server {
+
+// Wire format of the render service. Both ends run on the same machine, so fields travel in host byte order.
+//
+// A connection carries any number of requests, one after another. Request: RequestHeader, then scene_size bytes of
+// scene (text or binary format). Response: ResponseHeader, then either message_size bytes of error text or the image
+// as a stream of TileHeader + 3 * count bytes of RGB, pixels in region order, ended by a tile with count 0.
+constexpr std::uint32_t request_magic = 0x51525452;  // "RTRQ"
+constexpr std::uint32_t protocol_version = 1;
+// Requests with larger scenes are refused before anything is allocated for them.
+constexpr std::uint64_t max_scene_size = 1ull << 30;
+
+struct RequestHeader {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint64_t scene_size;
+    std::uint32_t samples;
+    std::uint32_t has_seed;
+    std::uint64_t seed;
+    std::uint32_t region[4];
+    std::uint32_t integrator;
+    std::uint32_t packet_width;
+    std::uint32_t light_sampling;
+    std::uint32_t reserved;
+};
+
+struct ResponseHeader {
+    // 0 on success.
+    std::uint32_t status;
+    std::uint32_t width;
+    std::uint32_t height;
+    // 1 when the scene came from the server's cache.
+    std::uint32_t cached;
+    std::uint64_t message_size;
+};
+
+struct TileHeader {
+    std::uint32_t begin;
+    std::uint32_t count;
+};
+
+// Serves render requests on a Unix socket until the process is stopped. Every connection gets its own thread; all
+// of them render on the renderer's pool, which splits the workers fairly between concurrent requests. Parsed scenes
+// with their light distributions and BVH are kept in a cache keyed by a hash of the scene bytes and light sampling
+// mode, so a repeated scene skips parsing and preparation.
+void serve(const std::string& socket_path, Renderer& renderer, std::size_t cache_capacity = 16, bool verbose = false);
+
+struct ClientResult {
+    std::uint32_t width;
+    std::uint32_t height;
+    bool cached;
+    Image image;
+};
+
+// Sends one render request to a server and assembles the streamed tiles. Throws with the server's message on
+// failure.
+ClientResult request(const std::string& socket_path,
+                     const std::string& scene,
+                     const RenderOptions& options,
+                     LIGHT_SAMPLING light_sampling);
+
+} // namespace engine::server
@@ -0,0 +1,365 @@
+#include "shard.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+namespace engine::shard {
+
+namespace {
+
+constexpr char partial_magic[4] = {'R', 'T', 'P', 'I'};
+constexpr char samples_magic[4] = {'R', 'T', 'S', 'A'};
+constexpr std::uint32_t partial_version = 2;
+
+template <typename T>
+void write_value(std::ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+T read_value(std::istream& in) {
+    T value;
+    in.read(reinterpret_cast<char*>(&value), sizeof(value));
+    if (!in) {
+        throw std::runtime_error("Unexpected end of partial image.");
+    }
+    return value;
+}
+
+template <typename T, typename Allocator>
+void write_array(std::ostream& out, const std::vector<T, Allocator>& values) {
+    out.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+}
+
+template <typename T, typename Allocator>
+void read_array(std::istream& in, std::vector<T, Allocator>& values) {
+    in.read(reinterpret_cast<char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+    if (!in) {
+        throw std::runtime_error("Unexpected end of partial image.");
+    }
+}
+
+// Opens a partial image and checks its magic and version; the size and region follow.
+std::ifstream open_partial(const std::string& path, const char (&magic)[4]) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        throw std::runtime_error("Bad path to partial image: " + path);
+    }
+    char found[4] = {};
+    in.read(found, sizeof(found));
+    if (!std::equal(found, found + 4, magic)) {
+        throw std::runtime_error("Not a partial image: " + path);
+    }
+    if (read_value<std::uint32_t>(in) != partial_version) {
+        throw std::runtime_error("Unsupported partial image version: " + path);
+    }
+    return in;
+}
+
+void write_header(std::ostream& out,
+                  const char (&magic)[4],
+                  std::uint32_t width,
+                  std::uint32_t height,
+                  const Region& region) {
+    out.write(magic, sizeof(magic));
+    write_value(out, partial_version);
+    write_value(out, width);
+    write_value(out, height);
+    write_value(out, region.x0);
+    write_value(out, region.y0);
+    write_value(out, region.x1);
+    write_value(out, region.y1);
+}
+
+void read_header(std::istream& in, const std::string& path, std::uint32_t& width, std::uint32_t& height, Region& region) {
+    width = read_value<std::uint32_t>(in);
+    height = read_value<std::uint32_t>(in);
+    region.x0 = read_value<std::uint32_t>(in);
+    region.y0 = read_value<std::uint32_t>(in);
+    region.x1 = read_value<std::uint32_t>(in);
+    region.y1 = read_value<std::uint32_t>(in);
+    if (region.empty() || region.x1 > width || region.y1 > height) {
+        throw std::runtime_error("Partial image region is outside the image: " + path);
+    }
+}
+
+bool is_samples(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    char found[4] = {};
+    in.read(found, sizeof(found));
+    return std::equal(found, found + 4, samples_magic);
+}
+
+bool same_region(const Region& a, const Region& b) {
+    return a.x0 == b.x0 && a.y0 == b.y0 && a.x1 == b.x1 && a.y1 == b.y1;
+}
+
+// Sample slices of one region added up so far, with the sample ranges they came from.
+struct SampleGroup {
+    std::string path;
+    Samples samples;
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> ranges;
+};
+
+} // namespace
+
+Region tile_region(std::uint32_t width, std::uint32_t height, std::uint32_t index, std::uint32_t count) {
+    if (count == 0 || index >= count || count > height) {
+        throw std::runtime_error("Tile " + std::to_string(index) + " of " + std::to_string(count) +
+                                 " does not exist in an image of " + std::to_string(height) + " rows.");
+    }
+    auto row = [&](std::uint32_t band) {
+        return static_cast<std::uint32_t>(static_cast<std::uint64_t>(height) * band / count);
+    };
+    return Region{0, row(index), width, row(index + 1)};
+}
+
+std::pair<std::uint32_t, std::uint32_t> parse_tile(const std::string& text) {
+    std::size_t slash = text.find('/');
+    if (slash == std::string::npos) {
+        throw std::runtime_error("Tiles must be given as <index>/<count>: " + text);
+    }
+    auto parse = [&](const char* begin, const char* end) {
+        std::uint32_t value = 0;
+        auto [last, error] = std::from_chars(begin, end, value);
+        if (begin == end || error != std::errc() || last != end) {
+            throw std::runtime_error("Tiles must be given as <index>/<count>: " + text);
+        }
+        return value;
+    };
+    std::uint32_t index = parse(text.data(), text.data() + slash);
+    std::uint32_t count = parse(text.data() + slash + 1, text.data() + text.size());
+    if (count == 0 || index >= count) {
+        throw std::runtime_error("Tile index must be below the tile count: " + text);
+    }
+    return {index, count};
+}
+
+std::pair<std::uint32_t, std::uint32_t> sample_slice(std::uint32_t samples, std::uint32_t index, std::uint32_t count) {
+    if (count == 0 || index >= count || count > samples) {
+        throw std::runtime_error("Sample slice " + std::to_string(index) + " of " + std::to_string(count) +
+                                 " does not exist for " + std::to_string(samples) + " samples.");
+    }
+    auto sample = [&](std::uint32_t slice) {
+        return static_cast<std::uint32_t>(static_cast<std::uint64_t>(samples) * slice / count);
+    };
+    return {sample(index), sample(index + 1)};
+}
+
+void write_partial(const std::string& path, const Partial& partial) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) {
+        throw std::runtime_error("Bad path to partial image: " + path);
+    }
+    write_header(out, partial_magic, partial.width, partial.height, partial.region);
+    write_array(out, partial.radiance);
+    if (!out) {
+        throw std::runtime_error("Failed to write partial image: " + path);
+    }
+}
+
+Partial read_partial(const std::string& path) {
+    std::ifstream in = open_partial(path, partial_magic);
+    Partial partial;
+    read_header(in, path, partial.width, partial.height, partial.region);
+    partial.radiance.resize(partial.region.size());
+    read_array(in, partial.radiance);
+    return partial;
+}
+
+void write_samples(const std::string& path, const Samples& samples) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) {
+        throw std::runtime_error("Bad path to partial image: " + path);
+    }
+    write_header(out, samples_magic, samples.width, samples.height, samples.region);
+    write_value(out, samples.total);
+    write_value(out, samples.accumulation.first);
+    write_value(out, samples.accumulation.last);
+    write_array(out, samples.accumulation.sum);
+    write_array(out, samples.accumulation.count);
+    if (!out) {
+        throw std::runtime_error("Failed to write partial image: " + path);
+    }
+}
+
+Samples read_samples(const std::string& path) {
+    std::ifstream in = open_partial(path, samples_magic);
+    Samples samples;
+    read_header(in, path, samples.width, samples.height, samples.region);
+    samples.total = read_value<std::uint32_t>(in);
+    samples.accumulation.first = read_value<std::uint32_t>(in);
+    samples.accumulation.last = read_value<std::uint32_t>(in);
+    if (samples.accumulation.last < samples.accumulation.first || samples.accumulation.last > samples.total) {
+        throw std::runtime_error("Partial image sample range is outside [0, " + std::to_string(samples.total) +
+                                 "): " + path);
+    }
+    samples.accumulation.resize(samples.region.size());
+    read_array(in, samples.accumulation.sum);
+    read_array(in, samples.accumulation.count);
+    return samples;
+}
+
+Partial merge(const std::vector<std::string>& paths) {
+    trace::Span span("merge");
+    if (paths.empty()) {
+        throw std::runtime_error("Nothing to merge.");
+    }
+    // Partial images with the path they came from; sample slices are added up per region and stitched after them.
+    std::vector<std::pair<std::string, Partial>> partials;
+    std::vector<SampleGroup> groups;
+    for (const std::string& path : paths) {
+        if (!is_samples(path)) {
+            partials.emplace_back(path, read_partial(path));
+            continue;
+        }
+        Samples samples = read_samples(path);
+        const std::pair<std::uint32_t, std::uint32_t> range{samples.accumulation.first, samples.accumulation.last};
+        auto group = std::find_if(groups.begin(), groups.end(), [&](const SampleGroup& g) {
+            return same_region(g.samples.region, samples.region);
+        });
+        if (group == groups.end()) {
+            groups.push_back(SampleGroup{path, std::move(samples), {range}});
+            continue;
+        }
+        if (samples.width != group->samples.width || samples.height != group->samples.height) {
+            throw std::runtime_error("Partial image " + path + " belongs to an image of another size.");
+        }
+        if (samples.total != group->samples.total) {
+            throw std::runtime_error("Partial image " + path + " belongs to a render with another sample count.");
+        }
+        for (const auto& [first, last] : group->ranges) {
+            if (range.first < last && first < range.second) {
+                throw std::runtime_error("Partial image " + path + " overlaps the sample range of another one.");
+            }
+        }
+        group->samples.accumulation.add(samples.accumulation);
+        group->ranges.push_back(range);
+    }
+    for (SampleGroup& group : groups) {
+        std::sort(group.ranges.begin(), group.ranges.end());
+        std::uint32_t covered = 0;
+        for (const auto& [first, last] : group.ranges) {
+            if (first != covered) {
+                break;
+            }
+            covered = last;
+        }
+        if (covered != group.samples.total) {
+            throw std::runtime_error("Partial images of the region of " + group.path + " do not cover all " +
+                                     std::to_string(group.samples.total) + " samples.");
+        }
+        const Samples& samples = group.samples;
+        Partial partial{samples.width, samples.height, samples.region, HdrImage(samples.region.size())};
+        for (std::size_t i = 0; i < partial.radiance.size(); ++i) {
+            partial.radiance[i] = samples.accumulation.mean(i);
+        }
+        partials.emplace_back(group.path, std::move(partial));
+        group.samples.accumulation = Accumulation{};
+    }
+
+    Partial result;
+    std::vector<bool> covered;
+    for (const auto& [path, partial] : partials) {
+        if (result.radiance.empty()) {
+            result.width = partial.width;
+            result.height = partial.height;
+            result.region = Region{0, 0, partial.width, partial.height};
+            result.radiance.resize(result.region.size());
+            covered.resize(result.region.size());
+        }
+        else if (partial.width != result.width || partial.height != result.height) {
+            throw std::runtime_error("Partial image " + path + " belongs to an image of another size.");
+        }
+        const Region& region = partial.region;
+        for (std::uint32_t y = region.y0; y < region.y1; ++y) {
+            const std::size_t row = static_cast<std::size_t>(y) * result.width;
+            for (std::uint32_t x = region.x0; x < region.x1; ++x) {
+                if (covered[row + x]) {
+                    throw std::runtime_error("Partial image " + path + " overlaps another one.");
+                }
+                covered[row + x] = true;
+            }
+            std::copy_n(partial.radiance.begin() + static_cast<std::size_t>(y - region.y0) * region.width(),
+                        region.width(), result.radiance.begin() + row + region.x0);
+        }
+    }
+    if (std::find(covered.begin(), covered.end(), false) != covered.end()) {
+        throw std::runtime_error("Partial images do not cover the whole image.");
+    }
+    return result;
+}
+
+int start_process(const std::vector<std::string>& command) {
+    std::vector<char*> argv;
+    for (const std::string& arg : command) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+    pid_t pid = 0;
+    int error = posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(), environ);
+    if (error != 0) {
+        throw std::runtime_error("Failed to start " + command[0] + ": " + std::strerror(error));
+    }
+    return pid;
+}
+
+bool wait_processes(const std::vector<int>& pids, std::optional<std::chrono::milliseconds> grace) {
+    const auto deadline = std::chrono::steady_clock::now() + grace.value_or(std::chrono::milliseconds(0));
+    bool success = true;
+    for (pid_t pid : pids) {
+        int status = 0;
+        pid_t done = 0;
+        if (grace.has_value()) {
+            while ((done = waitpid(pid, &status, WNOHANG)) == 0 && std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            if (done == 0) {
+                kill(pid, SIGKILL);
+                waitpid(pid, &status, 0);
+                success = false;
+                continue;
+            }
+        }
+        else {
+            done = waitpid(pid, &status, 0);
+        }
+        if (done < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            success = false;
+        }
+    }
+    return success;
+}
+
+void run_processes(const std::vector<std::vector<std::string>>& commands) {
+    std::vector<int> children;
+    std::string failure;
+    for (const std::vector<std::string>& command : commands) {
+        try {
+            children.push_back(start_process(command));
+        }
+        catch (const std::runtime_error& e) {
+            failure = e.what();
+            break;
+        }
+    }
+    if (!wait_processes(children) && failure.empty()) {
+        failure = "A render process failed.";
+    }
+    if (!failure.empty()) {
+        throw std::runtime_error(failure);
+    }
+}
+
+} // namespace engine::shard
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "image.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace engine::shard {
+
+// Band `index` of `count` equal bands of rows, the last ones one row shorter when the height does not divide.
+Region tile_region(std::uint32_t width, std::uint32_t height, std::uint32_t index, std::uint32_t count);
+// "2/8" -> {2, 8}; throws unless 0 <= index < count.
+std::pair<std::uint32_t, std::uint32_t> parse_tile(const std::string& text);
+// Sample indices [first, last) of slice `index` of `count` near-equal slices of `samples`.
+std::pair<std::uint32_t, std::uint32_t> sample_slice(std::uint32_t samples, std::uint32_t index, std::uint32_t count);
+
+// Linear radiance of one region of a `width` x `height` image, row by row over the region.
+struct Partial {
+    std::uint32_t width = 0;
+    std::uint32_t height = 0;
+    Region region;
+    HdrImage radiance;
+};
+
+// Fixed point sums of a slice of the samples of every pixel of a region (see Accumulation).
+struct Samples {
+    std::uint32_t width = 0;
+    std::uint32_t height = 0;
+    Region region;
+    // Samples per pixel of the whole render the slice is part of.
+    std::uint32_t total = 0;
+    Accumulation accumulation;
+};
+
+void write_partial(const std::string& path, const Partial& partial);
+Partial read_partial(const std::string& path);
+void write_samples(const std::string& path, const Samples& samples);
+Samples read_samples(const std::string& path);
+
+// Stitches partial images and sample slices of one frame into the full image. Sample slices of the same region are
+// added up first, so the result is exactly that of rendering their combined sample range at once. Throws if the parts
+// disagree on the image size or sample count, overlap in pixels or sample ranges, or leave pixels or samples
+// uncovered.
+Partial merge(const std::vector<std::string>& paths);
+
+// Starts the command (the program path first, then its arguments) as a child process and returns its process id.
+// Throws if it cannot be started.
+int start_process(const std::vector<std::string>& command);
+// Waits for the processes to exit; false if one of them failed. With a grace period, the ones still running when it
+// runs out are killed and count as failed.
+bool wait_processes(const std::vector<int>& pids, std::optional<std::chrono::milliseconds> grace = std::nullopt);
+// Starts every command (the program path first, then its arguments) as a child process and waits for all of them.
+// Throws if one cannot be started or does not exit successfully.
+void run_processes(const std::vector<std::vector<std::string>>& commands);
+
+} // namespace engine::shard
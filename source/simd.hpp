@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// 32-byte vectors are passed in AVX registers only when AVX is enabled; the helpers are always inlined so the ABI
+// note GCC emits about it does not apply.
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+// The helpers are compiled once per ISA (see kernels.inl). Forcing them inline keeps an AVX copy from being emitted
+// as a shared symbol that the linker could pick for the baseline code.
+#define ENGINE_SIMD_INLINE [[gnu::always_inline]] inline
+
+namespace engine::simd {
+
+// N-wide float / int32 vectors on top of the GCC vector extension. The compiler lowers them to the widest registers
+// the target allows: 4 lanes map to one SSE register, 8 lanes to one AVX register (or two SSE registers).
+template <std::size_t N>
+struct vector_types {
+    typedef float f32 __attribute__((vector_size(N * sizeof(float))));
+    typedef std::int32_t i32 __attribute__((vector_size(N * sizeof(std::int32_t))));
+    typedef std::uint32_t u32 __attribute__((vector_size(N * sizeof(std::uint32_t))));
+};
+
+template <std::size_t N>
+using vfloat = typename vector_types<N>::f32;
+template <std::size_t N>
+using vmask = typename vector_types<N>::i32;
+template <std::size_t N>
+using vuint = typename vector_types<N>::u32;
+
+template <std::size_t N>
+ENGINE_SIMD_INLINE vfloat<N> broadcast(float value) {
+    return vfloat<N>{} + value;
+}
+
+template <std::size_t N>
+ENGINE_SIMD_INLINE vfloat<N> load(const float* data) {
+    vfloat<N> result;
+    __builtin_memcpy(&result, data, sizeof(result));
+    return result;
+}
+
+template <std::size_t N>
+ENGINE_SIMD_INLINE void store(float* data, vfloat<N> value) {
+    __builtin_memcpy(data, &value, sizeof(value));
+}
+
+template <std::size_t N>
+ENGINE_SIMD_INLINE vfloat<N> select(vmask<N> mask, vfloat<N> a, vfloat<N> b) {
+    return mask ? a : b;
+}
+
+template <std::size_t N>
+ENGINE_SIMD_INLINE vfloat<N> min(vfloat<N> a, vfloat<N> b) {
+    return a < b ? a : b;
+}
+
+template <std::size_t N>
+ENGINE_SIMD_INLINE vfloat<N> max(vfloat<N> a, vfloat<N> b) {
+    return a > b ? a : b;
+}
+
+template <std::size_t N>
+ENGINE_SIMD_INLINE vfloat<N> sqrt(vfloat<N> a) {
+#if defined(__AVX__)
+    if constexpr (N == 8) {
+        return (vfloat<N>)_mm256_sqrt_ps((__m256)a);
+    }
+#endif
+#if defined(__SSE__)
+    if constexpr (N == 4) {
+        return (vfloat<N>)_mm_sqrt_ps((__m128)a);
+    }
+#endif
+    vfloat<N> result;
+    for (std::size_t i = 0; i < N; ++i) {
+        result[i] = __builtin_sqrtf(a[i]);
+    }
+    return result;
+}
+
+// e^x for x <= 0 (positive inputs give 1, inputs below -87 give about 1e-38), relative error below 1e-5: 2^fraction
+// from a polynomial, the integer part added to the exponent bits.
+template <std::size_t N>
+ENGINE_SIMD_INLINE vfloat<N> exp_negative(vfloat<N> x) {
+    x = min<N>(max<N>(x, broadcast<N>(-87.f)), broadcast<N>(0.f));
+    vfloat<N> t = x * 1.44269504f;
+    vmask<N> integer = __builtin_convertvector(t, vmask<N>);
+    // Truncation rounds negative values up; step back to the floor.
+    integer += __builtin_convertvector(integer, vfloat<N>) > t;
+    vfloat<N> f = t - __builtin_convertvector(integer, vfloat<N>);
+    vfloat<N> p = 1.f + f * (0.693147182f + f * (0.240226507f + f * (0.0555041087f + f * (0.00961812911f +
+                                                                                             f * 0.00133335581f))));
+    return (vfloat<N>)((vmask<N>)p + (integer << 23));
+}
+
+template <std::size_t N>
+ENGINE_SIMD_INLINE bool any(vmask<N> mask) {
+    for (std::size_t i = 0; i < N; ++i) {
+        if (mask[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace engine::simd
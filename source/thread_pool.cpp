@@ -0,0 +1,97 @@
+#include "thread_pool.hpp"
+#include "numa.hpp"
+
+#include <algorithm>
+
+namespace engine {
+
+ThreadPool::ThreadPool(std::size_t threads, bool pin)
+    : turn(0),
+      stopping(false) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    const std::vector<int> cpus = pin ? numa::spread_cpus(threads) : std::vector<int>(threads, -1);
+    // The thread calling parallel_for works too, in the place of the first CPU.
+    for (std::size_t i = 1; i < threads; ++i) {
+        this->threads.emplace_back(&ThreadPool::worker, this, cpus[i]);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    job_ready.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+std::size_t ThreadPool::size() const {
+    return threads.size() + 1;
+}
+
+std::size_t ThreadPool::take(Job& job) {
+    std::size_t index = job.next++;
+    if (job.next == job.count) {
+        active.erase(std::find(active.begin(), active.end(), &job));
+    }
+    return index;
+}
+
+void ThreadPool::run(std::unique_lock<std::mutex>& lock, Job& job, std::size_t index) {
+    const std::function<void(std::size_t)>& task = *job.task;
+    lock.unlock();
+    std::exception_ptr error;
+    try {
+        task(index);
+    }
+    catch (...) {
+        error = std::current_exception();
+    }
+    lock.lock();
+    if (error && !job.error) {
+        job.error = error;
+    }
+    if (++job.done == job.count) {
+        job_done.notify_all();
+    }
+}
+
+void ThreadPool::worker(int cpu) {
+    if (cpu >= 0) {
+        numa::pin_thread({cpu});
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        job_ready.wait(lock, [this] { return stopping || !active.empty(); });
+        if (stopping) {
+            return;
+        }
+        Job& job = *active[turn++ % active.size()];
+        run(lock, job, take(job));
+    }
+}
+
+void ThreadPool::parallel_for(std::size_t count, const std::function<void(std::size_t)>& task) {
+    if (count == 0) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    Job job{&task, count, 0, 0, nullptr};
+    active.push_back(&job);
+    job_ready.notify_all();
+    // The caller only helps with its own tasks, so its latency does not depend on other jobs' tasks.
+    while (job.next < job.count) {
+        run(lock, job, take(job));
+    }
+    job_done.wait(lock, [&job] { return job.done == job.count; });
+    lock.unlock();
+    if (job.error) {
+        std::rethrow_exception(job.error);
+    }
+}
+
+} // namespace engine
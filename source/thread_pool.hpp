@@ -0,0 +1,58 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace engine {
+
+// Fixed set of worker threads kept alive across renders, so rendering many scenes pays thread creation once.
+class ThreadPool {
+public:
+    // 0 uses one thread per hardware thread. With `pin` every worker is pinned to one CPU, spread evenly over the NUMA
+    // nodes (numa::spread_cpus); the thread calling parallel_for is left where it is.
+    explicit ThreadPool(std::size_t threads = 0, bool pin = false);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    std::size_t size() const;
+
+    // Calls task(i) for every i in [0, count) on the workers and the calling thread, and returns once all calls are
+    // done. Tasks are handed out one at a time, so uneven tasks balance themselves. Calls from several threads run
+    // at the same time: workers take tasks from the active calls in turn, so each gets a fair share of the pool.
+    // The first exception thrown by a task is rethrown here after the others finish.
+    void parallel_for(std::size_t count, const std::function<void(std::size_t)>& task);
+
+private:
+    struct Job {
+        const std::function<void(std::size_t)>* task;
+        std::size_t count;
+        std::size_t next;
+        std::size_t done;
+        std::exception_ptr error;
+    };
+
+    // Pins itself to `cpu` first unless it is negative.
+    void worker(int cpu);
+    // Hands out the next task of the job; called with the lock held.
+    std::size_t take(Job& job);
+    // Runs one task with the lock released.
+    void run(std::unique_lock<std::mutex>& lock, Job& job, std::size_t index);
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable job_ready;
+    std::condition_variable job_done;
+    // Jobs that still have tasks to hand out, served round robin.
+    std::vector<Job*> active;
+    std::size_t turn;
+    bool stopping;
+};
+
+} // namespace engine
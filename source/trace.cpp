@@ -0,0 +1,95 @@
+#include "trace.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+namespace engine::trace {
+
+namespace {
+
+// Span names may carry paths and other user text: quotes, backslashes and control characters are escaped.
+std::string json_escape(const std::string& text) {
+    std::string result;
+    result.reserve(text.size());
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+            result += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            char code[8];
+            std::snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned char>(c));
+            result += code;
+        }
+        else {
+            result += c;
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+Tracer::Tracer()
+    : is_enabled(false),
+      next_thread_index(0),
+      start(std::chrono::steady_clock::now()) {}
+
+void Tracer::enable() {
+    is_enabled = true;
+}
+
+bool Tracer::enabled() const {
+    return is_enabled.load(std::memory_order_relaxed);
+}
+
+std::uint32_t Tracer::thread_index() {
+    thread_local std::uint32_t index = next_thread_index++;
+    return index;
+}
+
+void Tracer::record(std::string name, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end) {
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+
+    Event event{std::move(name),
+                thread_index(),
+                duration_cast<microseconds>(begin - start).count(),
+                duration_cast<microseconds>(end - begin).count()};
+    std::lock_guard<std::mutex> lock(mutex);
+    events.push_back(std::move(event));
+}
+
+void Tracer::write(const std::string& path) {
+    std::ofstream out(path);
+    if (!out.is_open()) {
+        throw std::runtime_error("Bad path to trace file.");
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    out << "{\"traceEvents\":[\n";
+    for (std::size_t i = 0; i < events.size(); ++i) {
+        const Event& event = events[i];
+        out << "{\"name\":\"" << json_escape(event.name) << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << event.tid
+            << ",\"ts\":" << event.begin << ",\"dur\":" << event.duration << '}'
+            << (i + 1 < events.size() ? ",\n" : "\n");
+    }
+    out << "],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+Span::Span(std::string name)
+    : name(std::move(name)),
+      active(Tracer::get_instance().enabled()) {
+    if (active) {
+        begin = std::chrono::steady_clock::now();
+    }
+}
+
+Span::~Span() {
+    if (active) {
+        Tracer::get_instance().record(std::move(name), begin, std::chrono::steady_clock::now());
+    }
+}
+
+} // namespace engine::trace
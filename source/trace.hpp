@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace engine::trace {
+
+// Complete ("ph": "X") event of the Chrome trace format, times in microseconds.
+struct Event {
+    std::string name;
+    std::uint32_t tid;
+    std::int64_t begin;
+    std::int64_t duration;
+};
+
+class Tracer {
+public:
+    static Tracer& get_instance() {
+        static Tracer instance;
+        return instance;
+    }
+
+    void enable();
+    bool enabled() const;
+
+    void record(std::string name, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end);
+    void write(const std::string& path);
+
+private:
+    Tracer();
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    std::uint32_t thread_index();
+
+    std::atomic<bool> is_enabled;
+    std::atomic<std::uint32_t> next_thread_index;
+    std::chrono::steady_clock::time_point start;
+    std::mutex mutex;
+    std::vector<Event> events;
+};
+
+// Records the lifetime of the object as one span; does nothing while tracing is disabled.
+class Span {
+public:
+    explicit Span(std::string name);
+    ~Span();
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+private:
+    std::string name;
+    std::chrono::steady_clock::time_point begin;
+    bool active;
+};
+
+} // namespace engine::trace
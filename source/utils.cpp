@@ -1,4 +1,5 @@
 #include "utils.hpp"
+#include "kernels.hpp"
 
 #include "glm/common.hpp"
 #include "glm/exponential.hpp"
@@ -6,8 +7,13 @@
 
 #include <algorithm>
 #include <cmath>
+#include <chrono>
 #include <random>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
 namespace engine {
 
 float tone_map(float in) {
@@ -26,17 +32,66 @@ std::uint8_t color_converter(float in) {
     return std::round(std::clamp(in * 255, 0.f, 255.f));
 }
 
-static std::random_device rd;
-static std::minstd_rand gen(rd());
+// Uniform numbers come in batches from the SIMD kernel; every thread has its own generator state and buffer.
+namespace {
+
+struct UniformBuffer {
+    static constexpr std::size_t size = 256;
+
+    std::uint32_t state[8];
+    float values[size];
+    std::size_t next = size;
+
+    UniformBuffer() {
+        std::random_device rd;
+        for (std::uint32_t& lane : state) {
+            do {
+                lane = rd();
+            } while (lane == 0);
+        }
+    }
+};
+
+thread_local UniformBuffer buffer;
+
+} // namespace
+
+std::uint64_t mix_seed(std::uint64_t seed, std::uint64_t stream) {
+    // splitmix64 finalizer over the combined value.
+    std::uint64_t z = seed + 0x9E3779B97F4A7C15ull * (stream + 1);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+void seed_uniform01(std::uint64_t seed) {
+    for (std::uint32_t lane = 0; lane < 8; ++lane) {
+        std::uint64_t value = mix_seed(seed, lane);
+        buffer.state[lane] = static_cast<std::uint32_t>(value) | 1u;
+    }
+    buffer.next = UniformBuffer::size;
+}
 
 float rand_uniform01() {
-    static std::uniform_real_distribution<> rnd(0, 1);
-    return rnd(gen);
+    if (buffer.next == UniformBuffer::size) {
+        kernels().uniform01(buffer.state, buffer.values, UniformBuffer::size);
+        buffer.next = 0;
+    }
+    return buffer.values[buffer.next++];
 }
 
 float rand_normal01() {
-    static std::normal_distribution<> rnd(0, 1);
+    thread_local std::minstd_rand gen(std::random_device{}());
+    std::normal_distribution<> rnd(0, 1);
     return rnd(gen);
 }
 
+std::uint64_t cycle_counter() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
 } // namespace engine
@@ -9,6 +9,13 @@ float tone_map(float in);
 std::uint8_t color_converter(float in);
 
 float rand_uniform01();
+// Restarts the calling thread's rand_uniform01 stream from the seed.
+void seed_uniform01(std::uint64_t seed);
+// Seed of stream number `stream` derived from a base seed, well mixed even for consecutive streams.
+std::uint64_t mix_seed(std::uint64_t seed, std::uint64_t stream);
 float rand_normal01();
 
+// Cycle counter of the current core (falls back to steady_clock nanoseconds off x86).
+std::uint64_t cycle_counter();
+
 } // namespace engine
@@ -0,0 +1,335 @@
+#include "wavefront.hpp"
+#include "distributions.hpp"
+#include "glm/geometric.hpp"
+#include "primitive.hpp"
+#include "ray.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace engine::wavefront {
+
+namespace {
+
+constexpr std::size_t batch_size = 1u << 14;
+constexpr float eps = 1e-4;
+constexpr std::uint32_t no_primitive = std::numeric_limits<std::uint32_t>::max();
+
+struct Paths {
+    std::vector<std::uint32_t> pixel;
+    std::vector<float> time;
+    std::vector<glm::vec3> weight;
+    std::vector<glm::vec3> radiance;
+
+    void resize(std::size_t size) {
+        pixel.resize(size);
+        time.resize(size);
+        weight.assign(size, glm::vec3{1.f, 1.f, 1.f});
+        radiance.assign(size, glm::vec3{0.f, 0.f, 0.f});
+    }
+};
+
+struct RayQueue {
+    std::vector<std::uint32_t> path;
+    std::vector<glm::vec3> origin;
+    std::vector<glm::vec3> direction;
+
+    std::size_t size() const {
+        return path.size();
+    }
+
+    void clear() {
+        path.clear();
+        origin.clear();
+        direction.clear();
+    }
+
+    void push(std::uint32_t path_id, glm::vec3 start, glm::vec3 dir) {
+        path.push_back(path_id);
+        origin.push_back(start);
+        direction.push_back(dir);
+    }
+};
+
+struct HitQueue {
+    std::vector<std::uint32_t> path;
+    std::vector<std::uint32_t> primitive;
+    // Shape that was hit, which differs from the scene primitive inside instances.
+    std::vector<Shape*> shape;
+    std::vector<glm::vec3> direction;
+    std::vector<glm::vec3> point;
+    std::vector<glm::vec3> normal;
+    std::vector<std::uint8_t> inside;
+
+    std::size_t size() const {
+        return path.size();
+    }
+
+    void resize(std::size_t size) {
+        path.resize(size);
+        primitive.resize(size);
+        shape.resize(size);
+        direction.resize(size);
+        point.resize(size);
+        normal.resize(size);
+        inside.resize(size);
+    }
+};
+
+struct Queues {
+    Paths paths;
+    RayQueue rays;
+    RayQueue next_rays;
+    HitQueue hits;
+    HitQueue sorted_hits;
+    std::vector<std::uint32_t> closest_primitive;
+    std::vector<Shape*> closest_shape;
+    std::vector<Intersection> closest_inter;
+    std::vector<std::uint32_t> bucket_offsets;
+    std::vector<glm::vec3> sampled_direction;
+    std::vector<float> sampled_pdf;
+};
+
+void generate(const Scene& scene,
+              std::uint32_t samples,
+              const Region& region,
+              std::size_t first_path,
+              std::size_t count,
+              std::size_t begin,
+              Queues& q) {
+    q.paths.resize(count);
+    q.rays.clear();
+    for (std::size_t i = 0; i < count; ++i) {
+        std::size_t pixel = begin + (first_path + i) / samples;
+        q.paths.pixel[i] = static_cast<std::uint32_t>(pixel);
+        std::uint32_t col = region.x0 + static_cast<std::uint32_t>(pixel % region.width());
+        std::uint32_t row = region.y0 + static_cast<std::uint32_t>(pixel / region.width());
+        ray::Ray ray = ray::generate_ray(scene, {col, row});
+        q.paths.time[i] = ray.time;
+        q.rays.push(static_cast<std::uint32_t>(i), ray.start, ray.direction);
+    }
+}
+
+void intersect(const Scene& scene, Queues& q) {
+    const std::size_t n = q.rays.size();
+    q.closest_primitive.assign(n, no_primitive);
+    q.closest_shape.resize(n);
+    q.closest_inter.resize(n);
+
+    ray::Ray ray{};
+    for (std::size_t i = 0; i < n; ++i) {
+        ray.start = q.rays.origin[i];
+        ray.direction = q.rays.direction[i];
+        ray.time = q.paths.time[q.rays.path[i]];
+        auto hit = ray::closest_intersection(ray, scene);
+        if (hit.has_value()) {
+            q.closest_primitive[i] = hit->index;
+            q.closest_shape[i] = hit->primitive;
+            q.closest_inter[i] = hit->inter;
+        }
+    }
+}
+
+// Terminates missed paths and compacts the hits into q.hits.
+void compact_hits(const Scene& scene, Queues& q) {
+    const std::size_t n = q.rays.size();
+    q.hits.resize(n);
+    std::size_t hits = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        std::uint32_t path = q.rays.path[i];
+        if (q.closest_primitive[i] == no_primitive) {
+            q.paths.radiance[path] += q.paths.weight[path] * scene.bg_color;
+            continue;
+        }
+        q.hits.path[hits] = path;
+        q.hits.primitive[hits] = q.closest_primitive[i];
+        q.hits.shape[hits] = q.closest_shape[i];
+        q.hits.direction[hits] = q.rays.direction[i];
+        q.hits.point[hits] = q.rays.origin[i] + q.rays.direction[i] * q.closest_inter[i].t;
+        q.hits.normal[hits] = q.closest_inter[i].normal;
+        q.hits.inside[hits] = q.closest_inter[i].inside;
+        ++hits;
+    }
+    q.hits.resize(hits);
+}
+
+// Order of the material ranges in the sorted hit queue.
+std::size_t material_rank(MATERIAL_TYPE material) {
+    switch (material) {
+    case MATERIAL_TYPE::Diffuse:
+        return 0;
+    case MATERIAL_TYPE::Metallic:
+        return 1;
+    case MATERIAL_TYPE::Dielectric:
+        return 2;
+    default:
+        throw std::runtime_error("Unknown material type.");
+    }
+}
+
+// Counting sort of the hits by (material, primitive). Returns the end of the diffuse and metallic ranges;
+// dielectric hits follow up to the end of q.sorted_hits.
+std::pair<std::size_t, std::size_t> sort_hits(const Scene& scene, Queues& q) {
+    const std::size_t primitives = scene.primitives.size();
+    auto key = [&](std::size_t i) {
+        return material_rank(q.hits.shape[i]->material) * primitives + q.hits.primitive[i];
+    };
+
+    q.bucket_offsets.assign(3 * primitives + 1, 0);
+    for (std::size_t i = 0; i < q.hits.size(); ++i) {
+        ++q.bucket_offsets[key(i) + 1];
+    }
+    for (std::size_t b = 1; b < q.bucket_offsets.size(); ++b) {
+        q.bucket_offsets[b] += q.bucket_offsets[b - 1];
+    }
+    std::size_t diffuse_end = q.bucket_offsets[(material_rank(MATERIAL_TYPE::Diffuse) + 1) * primitives];
+    std::size_t metallic_end = q.bucket_offsets[(material_rank(MATERIAL_TYPE::Metallic) + 1) * primitives];
+
+    q.sorted_hits.resize(q.hits.size());
+    for (std::size_t i = 0; i < q.hits.size(); ++i) {
+        std::size_t j = q.bucket_offsets[key(i)]++;
+        q.sorted_hits.path[j] = q.hits.path[i];
+        q.sorted_hits.primitive[j] = q.hits.primitive[i];
+        q.sorted_hits.shape[j] = q.hits.shape[i];
+        q.sorted_hits.direction[j] = q.hits.direction[i];
+        q.sorted_hits.point[j] = q.hits.point[i];
+        q.sorted_hits.normal[j] = q.hits.normal[i];
+        q.sorted_hits.inside[j] = q.hits.inside[i];
+    }
+    return {diffuse_end, metallic_end};
+}
+
+// Samples the outgoing direction of diffuse hits from the scene's light / cosine mixture. A zero pdf marks a sample
+// below the surface, which ends the path.
+void light_sample(const Scene& scene, std::size_t begin, std::size_t end, Queues& q) {
+    const HitQueue& hits = q.sorted_hits;
+    q.sampled_direction.resize(end - begin);
+    q.sampled_pdf.resize(end - begin);
+    for (std::size_t i = begin; i < end; ++i) {
+        glm::vec3 x = hits.point[i] + eps * hits.normal[i];
+        float time = q.paths.time[hits.path[i]];
+        glm::vec3 dir = scene.distribution->sample(x, hits.normal[i], time);
+        q.sampled_direction[i - begin] = dir;
+        q.sampled_pdf[i - begin] =
+            glm::dot(dir, hits.normal[i]) < 0 ? 0.f : scene.distribution->pdf(x, hits.normal[i], dir, time);
+    }
+}
+
+void shade_diffuse(std::size_t begin, std::size_t end, Queues& q) {
+    const HitQueue& hits = q.sorted_hits;
+    for (std::size_t i = begin; i < end; ++i) {
+        std::uint32_t path = hits.path[i];
+        Shape* obj = hits.shape[i];
+        q.paths.radiance[path] += q.paths.weight[path] * obj->emission;
+
+        float pdf = q.sampled_pdf[i - begin];
+        if (pdf == 0.f) {
+            continue;
+        }
+        glm::vec3 dir = glm::normalize(q.sampled_direction[i - begin]);
+        if (glm::dot(dir, hits.normal[i]) < 0) {
+            dir *= -1;
+        }
+        q.paths.weight[path] *= (1.f / pdf) * obj->color / rand::pi * glm::dot(dir, hits.normal[i]);
+        q.next_rays.push(path, hits.point[i] + dir * eps, dir);
+    }
+}
+
+void shade_metallic(std::size_t begin, std::size_t end, Queues& q) {
+    const HitQueue& hits = q.sorted_hits;
+    for (std::size_t i = begin; i < end; ++i) {
+        std::uint32_t path = hits.path[i];
+        Shape* obj = hits.shape[i];
+        q.paths.radiance[path] += q.paths.weight[path] * obj->emission;
+        q.paths.weight[path] *= obj->color;
+
+        glm::vec3 dir = hits.direction[i] - 2.f * hits.normal[i] * glm::dot(hits.normal[i], hits.direction[i]);
+        q.next_rays.push(path, hits.point[i] + dir * eps, dir);
+    }
+}
+
+void shade_dielectric(std::size_t begin, std::size_t end, Queues& q) {
+    const HitQueue& hits = q.sorted_hits;
+    for (std::size_t i = begin; i < end; ++i) {
+        std::uint32_t path = hits.path[i];
+        Shape* obj = hits.shape[i];
+        glm::vec3 in_dir = hits.direction[i];
+        glm::vec3 normal = hits.normal[i];
+
+        float cos_theta1 = glm::dot(-in_dir, normal);
+        float air_ior = 1.f;
+        float obj_ior = obj->ior;
+        if (hits.inside[i]) {
+            std::swap(air_ior, obj_ior);
+        }
+        float reflection_coef = std::pow((air_ior - obj_ior) / (air_ior + obj_ior), 2);
+        float sin_theta2 = (air_ior / obj_ior) * sqrt(1 - cos_theta1 * cos_theta1);
+
+        if (!hits.inside[i]) {
+            q.paths.radiance[path] += q.paths.weight[path] * obj->emission;
+        }
+
+        float coin_toss = rand_uniform01();
+        glm::vec3 dir{};
+        if (std::abs(sin_theta2) > 1 || coin_toss < reflection_coef) {
+            dir = in_dir - 2.f * normal * glm::dot(normal, in_dir);
+        }
+        else {
+            float cos_theta2 = sqrt(1 - sin_theta2 * sin_theta2);
+            dir = (air_ior / obj_ior) * in_dir + (air_ior / obj_ior * cos_theta1 - cos_theta2) * normal;
+            if (!hits.inside[i]) {
+                q.paths.weight[path] *= obj->color;
+            }
+        }
+        q.next_rays.push(path, hits.point[i] + dir * eps, dir);
+    }
+}
+
+} // namespace
+
+void render(const Scene& scene,
+            std::uint32_t samples,
+            const Region& region,
+            std::size_t begin,
+            std::size_t end,
+            glm::vec3* result) {
+    Queues q;
+    const std::size_t total_paths = (end - begin) * samples;
+    const float inv_samples = 1.f / static_cast<float>(samples);
+    std::fill(result + begin, result + end, glm::vec3{0.f, 0.f, 0.f});
+
+    for (std::size_t first = 0; first < total_paths; first += batch_size) {
+        const std::size_t count = std::min(batch_size, total_paths - first);
+        generate(scene, samples, region, first, count, begin, q);
+
+        for (std::uint32_t depth = 0; q.rays.size() > 0; ++depth) {
+            if (depth == scene.ray_depth) {
+                for (std::uint32_t path : q.rays.path) {
+                    q.paths.radiance[path] += q.paths.weight[path] * scene.bg_color;
+                }
+                break;
+            }
+            intersect(scene, q);
+            compact_hits(scene, q);
+            auto [diffuse_end, metallic_end] = sort_hits(scene, q);
+
+            q.next_rays.clear();
+            light_sample(scene, 0, diffuse_end, q);
+            shade_diffuse(0, diffuse_end, q);
+            shade_metallic(diffuse_end, metallic_end, q);
+            shade_dielectric(metallic_end, q.sorted_hits.size(), q);
+            std::swap(q.rays, q.next_rays);
+        }
+
+        for (std::size_t i = 0; i < count; ++i) {
+            result[q.paths.pixel[i]] += q.paths.radiance[i] * inv_samples;
+        }
+    }
+}
+
+} // namespace engine::wavefront
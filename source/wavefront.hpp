@@ -0,0 +1,21 @@
+#pragma once
+
+#include "image.hpp"
+#include "scene.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace engine::wavefront {
+
+// Breadth-first alternative to ray::raytrace: all samples of pixels [begin, end) of the region (in region order) are
+// traced as batches of paths that advance one bounce at a time through the generate / intersect / light-sample /
+// shade stages. Writes mean radiance of each pixel to result[pixel].
+void render(const Scene& scene,
+            std::uint32_t samples,
+            const Region& region,
+            std::size_t begin,
+            std::size_t end,
+            glm::vec3* result);
+
+} // namespace engine::wavefront